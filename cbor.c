@@ -0,0 +1,580 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include "cbor.h"
+#include <osapi.h>
+
+#define DTXT(...)   os_printf(__VA_ARGS__)
+//#define DTXT(...)
+
+// major types
+#define CBOR_UINT       0
+#define CBOR_NEGINT     1
+#define CBOR_BYTES      2
+#define CBOR_TEXT       3
+#define CBOR_ARRAY      4
+#define CBOR_MAP        5
+#define CBOR_SIMPLE     7
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param w
+ * @param major
+ * @param arg
+ */
+static void writeHead(CBOR_WRITER* w, int major, uint64_t arg);
+/**
+ * 
+ * @param w
+ * @param data
+ * @param len
+ */
+static void writeBytes(CBOR_WRITER* w, const void* data, int len);
+/**
+ * 
+ * @param r
+ * @param n
+ * @return 
+ */
+static uint64_t readBig(CBOR_READER* r, int n);
+/**
+ * 
+ * @param h
+ * @return 
+ */
+static float halfToFloat(uint16_t h);
+
+/******************************************************************************************************************
+ * public functions
+ *
+ */
+
+/**
+ * 
+ * @param w
+ * @param buf
+ * @param size
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborWriterBegin(CBOR_WRITER* w, uint8_t* buf, int size)
+{
+    if(buf == 0 || size < 1) {
+        return -1;
+    }
+    
+    w->buf = buf;
+    w->p   = buf;
+    w->end = buf + size;
+    w->err = 0;
+    
+    return 0;
+}
+/**
+ * 
+ * @param w
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborWriterEnd(CBOR_WRITER* w)
+{
+    if(w->err) {
+        DTXT("cborWriterEnd(): buffer too small\n");
+        return -1;
+    }
+    
+    return w->p - w->buf;
+}
+/**
+ * 
+ * @param w
+ * @param count
+ */
+void ICACHE_FLASH_ATTR cborMap(CBOR_WRITER* w, int count)
+{
+    writeHead(w, CBOR_MAP, count);
+}
+/**
+ * 
+ * @param w
+ * @param count
+ */
+void ICACHE_FLASH_ATTR cborArray(CBOR_WRITER* w, int count)
+{
+    writeHead(w, CBOR_ARRAY, count);
+}
+/**
+ * 
+ * @param w
+ * @param txt
+ */
+void ICACHE_FLASH_ATTR cborText(CBOR_WRITER* w, const char* txt)
+{
+    int len = os_strlen(txt);
+    
+    writeHead(w, CBOR_TEXT, len);
+    writeBytes(w, txt, len);
+}
+/**
+ * 
+ * @param w
+ * @param value
+ */
+void ICACHE_FLASH_ATTR cborUInt(CBOR_WRITER* w, uint64_t value)
+{
+    writeHead(w, CBOR_UINT, value);
+}
+/**
+ * 
+ * @param w
+ * @param value
+ */
+void ICACHE_FLASH_ATTR cborInt(CBOR_WRITER* w, sint64_t value)
+{
+    if(value < 0) {
+        writeHead(w, CBOR_NEGINT, (uint64_t)(-1 - value));
+    } else {
+        writeHead(w, CBOR_UINT, (uint64_t) value);
+    }
+}
+/**
+ * 
+ * @param w
+ * @param value
+ */
+void ICACHE_FLASH_ATTR cborFloat(CBOR_WRITER* w, float value)
+{
+    uint32_t bits;
+    uint8_t  b[5];
+    
+    os_memcpy(&bits, &value, sizeof(bits));
+    
+    b[0] = (CBOR_SIMPLE << 5) | 26;
+    b[1] = bits >> 24;
+    b[2] = bits >> 16;
+    b[3] = bits >> 8;
+    b[4] = bits;
+    
+    writeBytes(w, b, sizeof(b));
+}
+/**
+ * 
+ * @param w
+ * @param value
+ */
+void ICACHE_FLASH_ATTR cborBool(CBOR_WRITER* w, bool value)
+{
+    uint8_t b = (CBOR_SIMPLE << 5) | (value ? 21 : 20);
+    
+    writeBytes(w, &b, 1);
+}
+/**
+ * 
+ * @param w
+ */
+void ICACHE_FLASH_ATTR cborNull(CBOR_WRITER* w)
+{
+    uint8_t b = (CBOR_SIMPLE << 5) | 22;
+    
+    writeBytes(w, &b, 1);
+}
+/**
+ * 
+ * @param r
+ * @param buf
+ * @param len
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborReaderBegin(CBOR_READER* r, uint8_t* buf, int len)
+{
+    if(buf == 0 || len < 1) {
+        return -1;
+    }
+    
+    r->p   = buf;
+    r->end = buf + len;
+    
+    return 0;
+}
+/**
+ * 
+ * @param r
+ * @param item
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborNext(CBOR_READER* r, CBOR_ITEM* item)
+{
+    if(r->p >= r->end) {
+        return 1;
+    }
+    
+    int      major = *r->p >> 5;
+    int      info  = *r->p & 0x1f;
+    uint64_t arg;
+    
+    ++r->p;
+    
+    item->kind = CborNone;
+    item->p    = 0;
+    item->len  = 0;
+    
+    if(major == CBOR_SIMPLE) {
+        switch(info) {
+            case 20: item->kind = CborFalse;    return 0;
+            case 21: item->kind = CborTrue;     return 0;
+            case 22: item->kind = CborNull;     return 0;
+            
+            case 25:
+                if(r->end - r->p < 2) {
+                    return -1;
+                }
+                
+                item->kind = CborFloat;
+                item->f    = halfToFloat((uint16_t) readBig(r, 2));
+                return 0;
+                
+            case 26: {
+                if(r->end - r->p < 4) {
+                    return -1;
+                }
+                
+                uint32_t bits = (uint32_t) readBig(r, 4);
+                float    f;
+                
+                os_memcpy(&f, &bits, sizeof(f));
+                
+                item->kind = CborFloat;
+                item->f    = f;
+                return 0;
+            }
+            
+            case 27: {
+                if(r->end - r->p < 8) {
+                    return -1;
+                }
+                
+                uint64_t bits = readBig(r, 8);
+                
+                os_memcpy(&item->f, &bits, sizeof(item->f));
+                
+                item->kind = CborFloat;
+                return 0;
+            }
+        }
+        
+        DTXT("cborNext(): unsupported simple value %d\n", info);
+        return -1;
+    }
+    
+    if(info < 24) {
+        arg = info;
+    } else if(info <= 27 && r->end - r->p >= (1 << (info - 24))) {
+        arg = readBig(r, 1 << (info - 24));
+    } else {
+        DTXT("cborNext(): unsupported length %d\n", info);      // indefinite lengths are not supported
+        return -1;
+    }
+    
+    item->u = arg;
+    
+    switch(major) {
+        case CBOR_UINT:
+            item->kind = CborUInt;
+            return 0;
+            
+        case CBOR_NEGINT:
+            item->kind = CborNegInt;
+            return 0;
+            
+        case CBOR_BYTES:
+        case CBOR_TEXT:
+            if(arg > (uint64_t)(r->end - r->p)) {
+                return -1;
+            }
+            
+            item->kind = (major == CBOR_TEXT) ? CborText : CborBytes;
+            item->p    = r->p;
+            item->len  = (int) arg;
+            
+            r->p += item->len;
+            return 0;
+            
+        case CBOR_ARRAY:
+        case CBOR_MAP:
+            if(arg > (uint64_t)(r->end - r->p)) {
+                return -1;                                      // each item takes at least one byte
+            }
+            
+            item->kind = (major == CBOR_ARRAY) ? CborArray : CborMap;
+            item->len  = (int) arg;
+            return 0;
+    }
+    
+    DTXT("cborNext(): unsupported major type %d\n", major);    // tags
+    return -1;
+}
+/**
+ * 
+ * @param r
+ * @param item
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborSkip(CBOR_READER* r, CBOR_ITEM* item)
+{
+    CBOR_ITEM child;
+    uint32_t  pending;
+    
+    if(item->kind != CborArray && item->kind != CborMap) {
+        return 0;
+    }
+    
+    // iterative; the nesting depth is up to the sender, the stack isn't
+    pending = (item->kind == CborMap) ? (uint32_t) item->len * 2 : (uint32_t) item->len;
+    
+    while(pending > 0) {
+        // every pending item takes at least one byte
+        if(pending > (uint32_t) (r->end - r->p) || cborNext(r, &child) != 0) {
+            return -1;
+        }
+        
+        pending--;
+        
+        if(child.kind == CborArray) {
+            pending += (uint32_t) child.len;
+        } else if(child.kind == CborMap) {
+            pending += (uint32_t) child.len * 2;
+        }
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param item
+ * @return 
+ */
+const char* ICACHE_FLASH_ATTR cborString(CBOR_ITEM* item)
+{
+    if(item->kind != CborText) {
+        return 0;
+    }
+    
+    // the head is at least one byte long
+    os_memmove(item->p - 1, item->p, item->len);
+    
+    item->p            -= 1;
+    item->p[item->len]  = '\0';
+    item->kind          = CborNone;     // once only
+    
+    return (const char*) item->p;
+}
+/**
+ * 
+ * @param item
+ * @param txt
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborTextIs(CBOR_ITEM* item, const char* txt)
+{
+    if(item->kind != CborText || (int) os_strlen(txt) != item->len) {
+        return 0;
+    }
+    
+    return os_memcmp(item->p, txt, item->len) == 0;
+}
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborGetInt64(CBOR_ITEM* item, sint64_t* value)
+{
+    if(item->kind == CborUInt && item->u <= 0x7fffffffffffffffULL) {
+        *value = (sint64_t) item->u;
+    } else if(item->kind == CborNegInt && item->u <= 0x7fffffffffffffffULL) {
+        *value = -1 - (sint64_t) item->u;
+    } else {
+        return -1;
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborGetUInt64(CBOR_ITEM* item, uint64_t* value)
+{
+    if(item->kind != CborUInt) {
+        return -1;
+    }
+    
+    *value = item->u;
+    
+    return 0;
+}
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborGetDouble(CBOR_ITEM* item, double* value)
+{
+    sint64_t i;
+    
+    if(item->kind == CborFloat) {
+        *value = item->f;
+    } else if(cborGetInt64(item, &i) == 0) {
+        *value = (double) i;
+    } else {
+        return -1;
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborGetBool(CBOR_ITEM* item, bool* value)
+{
+    switch(item->kind) {
+        case CborTrue:      *value = true;              return 0;
+        case CborFalse:     *value = false;             return 0;
+        case CborUInt:      *value = (item->u != 0);    return 0;
+        default:                                        return -1;
+    }
+}
+
+/******************************************************************************************************************
+ * private functions
+ *
+ */
+
+/**
+ * 
+ * @param w
+ * @param major
+ * @param arg
+ */
+void ICACHE_FLASH_ATTR writeHead(CBOR_WRITER* w, int major, uint64_t arg)
+{
+    uint8_t b[9];
+    int     n;
+    
+    if(arg < 24) {
+        b[0] = (major << 5) | (uint8_t) arg;
+        n    = 0;
+    } else if(arg <= 0xff) {
+        b[0] = (major << 5) | 24;
+        n    = 1;
+    } else if(arg <= 0xffff) {
+        b[0] = (major << 5) | 25;
+        n    = 2;
+    } else if(arg <= 0xffffffffULL) {
+        b[0] = (major << 5) | 26;
+        n    = 4;
+    } else {
+        b[0] = (major << 5) | 27;
+        n    = 8;
+    }
+    
+    // big endian
+    for(int i = n; i > 0; i--) {
+        b[i] = (uint8_t) arg;
+        arg >>= 8;
+    }
+    
+    writeBytes(w, b, n + 1);
+}
+/**
+ * 
+ * @param w
+ * @param data
+ * @param len
+ */
+void ICACHE_FLASH_ATTR writeBytes(CBOR_WRITER* w, const void* data, int len)
+{
+    if(w->err || w->end - w->p < len) {
+        w->err = 1;
+        return;
+    }
+    
+    os_memcpy(w->p, data, len);
+    w->p += len;
+}
+/**
+ * 
+ * @param r
+ * @param n
+ * @return 
+ */
+uint64_t ICACHE_FLASH_ATTR readBig(CBOR_READER* r, int n)
+{
+    uint64_t v = 0;
+    
+    while(n-- > 0) {
+        v = (v << 8) | *r->p++;
+    }
+    
+    return v;
+}
+/**
+ * 
+ * @param h
+ * @return 
+ */
+float ICACHE_FLASH_ATTR halfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp  = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    float    f;
+    
+    if(exp == 0) {
+        f = (float) mant / 16777216.0f;             // subnormal; mant * 2^-24
+        return sign ? -f : f;
+    } else if(exp == 31) {
+        bits = sign | 0x7f800000 | (mant << 13);    // infinity or NaN
+    } else {
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    }
+    
+    os_memcpy(&f, &bits, sizeof(f));
+    
+    return f;
+}
@@ -0,0 +1,217 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#ifndef CBOR_H
+#define	CBOR_H
+
+#include <github.com/mikejac/misc.esp8266-nonos.cpp/espmissingincludes.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************************************************
+ * 
+ * Minimal CBOR (RFC 7049) writer and reader for the binary service feeds. Only definite lengths are written and 
+ * read; floats are written in single precision, which is all a HomeKit float carries.
+ * 
+ * The reader works in place like the JSON scanner: integers and floats are decoded straight from the buffer and 
+ * text is zero-terminated inside the buffer by cborString(). Arrays and maps returned by cborNext() are not 
+ * consumed - the caller reads their 'len' items (twice that for maps) or steps over them with cborSkip().
+ *
+ */
+
+typedef enum {
+    CborNone,
+    CborUInt,
+    CborNegInt,
+    CborBytes,
+    CborText,
+    CborArray,
+    CborMap,
+    CborFalse,
+    CborTrue,
+    CborNull,
+    CborFloat
+} CBOR_KIND;
+
+typedef struct {
+    CBOR_KIND   kind;
+    uint64_t    u;              // integers; CborNegInt is -1 - u
+    double      f;              // CborFloat
+    uint8_t*    p;              // CborBytes, CborText; not zero-terminated, see cborString()
+    int         len;            // length of bytes and text, number of items of arrays and maps
+} CBOR_ITEM;
+
+typedef struct {
+    uint8_t*    buf;
+    uint8_t*    p;
+    uint8_t*    end;
+    int         err;
+} CBOR_WRITER;
+
+typedef struct {
+    uint8_t*    p;
+    uint8_t*    end;
+} CBOR_READER;
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param w
+ * @param buf
+ * @param size
+ * @return 
+ */
+int cborWriterBegin(CBOR_WRITER* w, uint8_t* buf, int size);
+/**
+ * 
+ * @param w
+ * @return the number of bytes written or -1 if the buffer was too small
+ */
+int cborWriterEnd(CBOR_WRITER* w);
+/**
+ * 
+ * @param w
+ * @param count
+ */
+void cborMap(CBOR_WRITER* w, int count);
+/**
+ * 
+ * @param w
+ * @param count
+ */
+void cborArray(CBOR_WRITER* w, int count);
+/**
+ * 
+ * @param w
+ * @param txt
+ */
+void cborText(CBOR_WRITER* w, const char* txt);
+/**
+ * 
+ * @param w
+ * @param value
+ */
+void cborUInt(CBOR_WRITER* w, uint64_t value);
+/**
+ * 
+ * @param w
+ * @param value
+ */
+void cborInt(CBOR_WRITER* w, sint64_t value);
+/**
+ * 
+ * @param w
+ * @param value
+ */
+void cborFloat(CBOR_WRITER* w, float value);
+/**
+ * 
+ * @param w
+ * @param value
+ */
+void cborBool(CBOR_WRITER* w, bool value);
+/**
+ * 
+ * @param w
+ */
+void cborNull(CBOR_WRITER* w);
+/**
+ * 
+ * @param r
+ * @param buf
+ * @param len
+ * @return 
+ */
+int cborReaderBegin(CBOR_READER* r, uint8_t* buf, int len);
+/**
+ * 
+ * @param r
+ * @param item
+ * @return 0 = item read, 1 = end of data, -1 = error
+ */
+int cborNext(CBOR_READER* r, CBOR_ITEM* item);
+/**
+ * Steps over the contents of an array or map; does nothing for other items
+ * @param r
+ * @param item
+ * @return 
+ */
+int cborSkip(CBOR_READER* r, CBOR_ITEM* item);
+/**
+ * Zero-terminates a text item in place; the byte in front of the text (part of its head) is given up for it
+ * @param item
+ * @return the zero-terminated string or 0 if the item is not text
+ */
+const char* cborString(CBOR_ITEM* item);
+/**
+ * 
+ * @param item
+ * @param txt
+ * @return 1 if the item is the text 'txt'
+ */
+int cborTextIs(CBOR_ITEM* item, const char* txt);
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int cborGetInt64(CBOR_ITEM* item, sint64_t* value);
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int cborGetUInt64(CBOR_ITEM* item, uint64_t* value);
+/**
+ * Accepts integers as well
+ * @param item
+ * @param value
+ * @return 
+ */
+int cborGetDouble(CBOR_ITEM* item, double* value);
+/**
+ * Accepts integers as well (non-zero is true)
+ * @param item
+ * @param value
+ * @return 
+ */
+int cborGetBool(CBOR_ITEM* item, bool* value);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CBOR_H */
+
@@ -0,0 +1,110 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "flash_strings.h"
+#include <osapi.h>
+
+/******************************************************************************************************************
+ * 
+ *
+ */
+
+// read a single character using an aligned 32-bit load (the only access flash allows)
+#define flashChar(p)    ((char)(*((const uint32_t*)((uint32_t)(p) & ~3)) >> (((uint32_t)(p) & 3) << 3)))
+
+/******************************************************************************************************************
+ * public functions
+ *
+ */
+
+/**
+ * 
+ * @param s
+ * @return 
+ */
+int ICACHE_FLASH_ATTR flashStrlen(const char* s)
+{
+    int len = 0;
+    
+    while(flashChar(s + len) != '\0') {
+        ++len;
+    }
+    
+    return len;
+}
+/**
+ * Compares a RAM string with a string that may live in flash
+ * @param s
+ * @param flash
+ * @return 
+ */
+int ICACHE_FLASH_ATTR flashStrcmp(const char* s, const char* flash)
+{
+    char c;
+    
+    do {
+        c = flashChar(flash);
+        
+        if(*s != c) {
+            return (unsigned char)(*s) - (unsigned char)(c);
+        }
+        
+        ++s;
+        ++flash;
+    } while(c != '\0');
+    
+    return 0;
+}
+/**
+ * Copies a string that may live in flash into RAM; at most size - 1 characters are copied and 'dest' is always 
+ * zero-terminated
+ * @param dest
+ * @param flash
+ * @param size
+ * @return dest
+ */
+char* ICACHE_FLASH_ATTR flashStrcpy(char* dest, const char* flash, int size)
+{
+    int i = 0;
+    
+    if(size <= 0) {
+        return dest;
+    }
+    
+    while(i < size - 1) {
+        char c = flashChar(flash + i);
+        
+        if(c == '\0') {
+            break;
+        }
+        
+        dest[i++] = c;
+    }
+    
+    dest[i] = '\0';
+    
+    return dest;
+}
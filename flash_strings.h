@@ -0,0 +1,87 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef FLASH_STRINGS_H
+#define	FLASH_STRINGS_H
+
+#include <github.com/mikejac/misc.esp8266-nonos.cpp/espmissingincludes.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************************************************
+ * 
+ * With RPCMQTT_FLASH_STRINGS defined the constant string tables (characteristic/service types, formats, units, 
+ * class names and status message formats) are placed in flash instead of DRAM. Flash can only be read 32 bits at
+ * a time from 4-byte aligned addresses, so such strings must never be handed directly to code doing byte access
+ * (os_strcmp(), os_sprintf(), strcat(), JEncoder, os_printf("%s") etc.) - go through the helpers below, which 
+ * work on ordinary RAM strings as well.
+ * 
+ * The DTXT() debug format strings are moved to flash by the SDK itself when building with USE_OPTIMIZE_PRINTF.
+ *
+ */
+
+#ifdef RPCMQTT_FLASH_STRINGS
+#define FLASH_STR_ATTR                  ICACHE_RODATA_ATTR STORE_ATTR
+#else
+#define FLASH_STR_ATTR
+#endif
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param s
+ * @return 
+ */
+int flashStrlen(const char* s);
+/**
+ * Compares a RAM string with a string that may live in flash
+ * @param s
+ * @param flash
+ * @return 
+ */
+int flashStrcmp(const char* s, const char* flash);
+/**
+ * Copies a string that may live in flash into RAM; at most size - 1 characters are copied and 'dest' is always 
+ * zero-terminated
+ * @param dest
+ * @param flash
+ * @param size
+ * @return dest
+ */
+char* flashStrcpy(char* dest, const char* flash, int size);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* FLASH_STRINGS_H */
+
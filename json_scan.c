@@ -0,0 +1,620 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include "json_scan.h"
+#include <osapi.h>
+
+#define DTXT(...)   os_printf(__VA_ARGS__)
+//#define DTXT(...)
+
+// beyond these a double is infinite or zero whatever the (at most 18 digit) mantissa is
+#define SCAN_EXPONENT_MAX   330
+#define SCAN_EXPONENT_MIN   (-350)
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param s
+ */
+static void skipWhitespace(JSON_SCAN* s);
+/**
+ * 
+ * @param s
+ * @param item
+ * @return 
+ */
+static int scanItem(JSON_SCAN* s, JSON_ITEM* item);
+/**
+ * 
+ * @param s
+ * @param literal
+ * @param len
+ * @return 
+ */
+static int scanLiteral(JSON_SCAN* s, const char* literal, int len);
+/**
+ * 
+ * @param c
+ * @return 
+ */
+static int hexValue(char c);
+
+/******************************************************************************************************************
+ * public functions
+ *
+ */
+
+/**
+ * 
+ * @param s
+ * @param json
+ * @param len
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanBegin(JSON_SCAN* s, char* json, int len)
+{
+    if(json == 0 || len < 1) {
+        return -1;
+    }
+    
+    s->p   = json;
+    s->end = json + len;
+    
+    return 0;
+}
+/**
+ * Enters the object at the current position
+ * @param s
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanObject(JSON_SCAN* s)
+{
+    skipWhitespace(s);
+    
+    if(s->p >= s->end || *s->p != '{') {
+        return -1;
+    }
+    
+    ++s->p;
+    
+    return 0;
+}
+/**
+ * 
+ * @param s
+ * @param name
+ * @param item
+ * @return 0 = member found, 1 = end of object, -1 = error
+ */
+int ICACHE_FLASH_ATTR scanMember(JSON_SCAN* s, const char** name, JSON_ITEM* item)
+{
+    skipWhitespace(s);
+    
+    if(s->p < s->end && *s->p == '}') {
+        ++s->p;
+        return 1;
+    }
+    if(s->p < s->end && *s->p == ',') {
+        ++s->p;
+        skipWhitespace(s);
+    }
+    if(s->p >= s->end || *s->p != '"') {
+        return -1;
+    }
+    
+    // the name
+    if(scanItem(s, item) != 0) {
+        return -1;
+    }
+    
+    *name = item->p;
+    
+    skipWhitespace(s);
+    
+    if(s->p >= s->end || *s->p != ':') {
+        return -1;
+    }
+    
+    ++s->p;
+    
+    // the value
+    return scanItem(s, item);
+}
+/**
+ * Enters the array at the current position
+ * @param s
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanArray(JSON_SCAN* s)
+{
+    skipWhitespace(s);
+    
+    if(s->p >= s->end || *s->p != '[') {
+        return -1;
+    }
+    
+    ++s->p;
+    
+    return 0;
+}
+/**
+ * 
+ * @param s
+ * @param item
+ * @return 0 = element found, 1 = end of array, -1 = error
+ */
+int ICACHE_FLASH_ATTR scanElement(JSON_SCAN* s, JSON_ITEM* item)
+{
+    skipWhitespace(s);
+    
+    if(s->p < s->end && *s->p == ']') {
+        ++s->p;
+        return 1;
+    }
+    if(s->p < s->end && *s->p == ',') {
+        ++s->p;
+    }
+    
+    return scanItem(s, item);
+}
+/**
+ * 
+ * @param s
+ * @param item
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanValue(JSON_SCAN* s, JSON_ITEM* item)
+{
+    if(scanItem(s, item) != 0 || item->kind == JsonObject || item->kind == JsonArray) {
+        return -1;
+    }
+    
+    return 0;
+}
+/**
+ * Steps over a nested object or array; does nothing for other items
+ * @param s
+ * @param item
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanSkip(JSON_SCAN* s, JSON_ITEM* item)
+{
+    int depth = 0;
+    
+    if(item->kind != JsonObject && item->kind != JsonArray) {
+        return 0;
+    }
+    
+    while(s->p < s->end) {
+        switch(*s->p) {
+            case '{':
+            case '[':
+                ++depth;
+                break;
+                
+            case '}':
+            case ']':
+                if(--depth == 0) {
+                    ++s->p;
+                    return 0;
+                }
+                break;
+                
+            case '"':
+                // step over the string, escapes included
+                for(++s->p; s->p < s->end && *s->p != '"'; ++s->p) {
+                    if(*s->p == '\\') {
+                        ++s->p;
+                    }
+                }
+                break;
+        }
+        
+        ++s->p;
+    }
+    
+    return -1;
+}
+/**
+ * Unescapes a string item in place
+ * @param item
+ * @return the zero-terminated string or 0 if the item is not a string
+ */
+const char* ICACHE_FLASH_ATTR scanString(JSON_ITEM* item)
+{
+    if(item->kind != JsonString) {
+        return 0;
+    }
+    
+    if(item->escaped) {
+        char* r   = item->p;
+        char* w   = item->p;
+        char* end = item->p + item->len;
+        
+        while(r < end) {
+            if(*r != '\\' || r + 1 >= end) {
+                *w++ = *r++;
+                continue;
+            }
+            
+            ++r;
+            
+            switch(*r) {
+                case 'b':   *w++ = '\b';    break;
+                case 'f':   *w++ = '\f';    break;
+                case 'n':   *w++ = '\n';    break;
+                case 'r':   *w++ = '\r';    break;
+                case 't':   *w++ = '\t';    break;
+                
+                case 'u':
+                    if(r + 4 < end && hexValue(r[1]) >= 0 && hexValue(r[2]) >= 0 && hexValue(r[3]) >= 0 && hexValue(r[4]) >= 0) {
+                        unsigned int u = (hexValue(r[1]) << 12) | (hexValue(r[2]) << 8) | (hexValue(r[3]) << 4) | hexValue(r[4]);
+                        
+                        // UTF-8 encode; never longer than the 6 character escape sequence
+                        if(u < 0x80) {
+                            *w++ = (char) u;
+                        } else if(u < 0x800) {
+                            *w++ = (char)(0xC0 | (u >> 6));
+                            *w++ = (char)(0x80 | (u & 0x3F));
+                        } else {
+                            *w++ = (char)(0xE0 | (u >> 12));
+                            *w++ = (char)(0x80 | ((u >> 6) & 0x3F));
+                            *w++ = (char)(0x80 | (u & 0x3F));
+                        }
+                        
+                        r += 4;
+                    } else {
+                        *w++ = *r;
+                    }
+                    break;
+                    
+                default:    *w++ = *r;      break;      // '"', '\\' and '/'
+            }
+            
+            ++r;
+        }
+        
+        *w = '\0';
+        
+        item->len     = w - item->p;
+        item->escaped = 0;
+    }
+    
+    return item->p;
+}
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanInt64(JSON_ITEM* item, sint64_t* value)
+{
+    uint64_t v;
+    
+    if(item->kind != JsonNumber) {
+        return -1;
+    }
+    
+    if(item->p[0] == '-') {
+        JSON_ITEM abs = *item;
+        
+        ++abs.p;
+        --abs.len;
+        
+        if(scanUInt64(&abs, &v) != 0) {
+            return -1;
+        }
+        
+        *value = -((sint64_t) v);
+        
+        return 0;
+    }
+    
+    if(scanUInt64(item, &v) != 0) {
+        return -1;
+    }
+    
+    *value = (sint64_t) v;
+    
+    return 0;
+}
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanUInt64(JSON_ITEM* item, uint64_t* value)
+{
+    uint64_t v = 0;
+    int      i;
+    
+    if(item->kind != JsonNumber) {
+        return -1;
+    }
+    
+    // any fraction is truncated
+    for(i = 0; i < item->len && item->p[i] >= '0' && item->p[i] <= '9'; i++) {
+        v = v * 10 + (item->p[i] - '0');
+    }
+    
+    if(i == 0) {
+        return -1;
+    }
+    
+    *value = v;
+    
+    return 0;
+}
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanDouble(JSON_ITEM* item, double* value)
+{
+    uint64_t mantissa = 0;
+    int      digits   = 0;
+    int      exponent = 0;
+    int      negative = 0;
+    int      i        = 0;
+    double   v;
+    
+    if(item->kind != JsonNumber) {
+        return -1;
+    }
+    
+    if(i < item->len && item->p[i] == '-') {
+        negative = 1;
+        ++i;
+    }
+    
+    // integer part; digits beyond what fits in the mantissa only scale it
+    for(; i < item->len && item->p[i] >= '0' && item->p[i] <= '9'; i++, digits++) {
+        if(mantissa < 100000000000000000ULL) {
+            mantissa = mantissa * 10 + (item->p[i] - '0');
+        } else {
+            ++exponent;
+        }
+    }
+    
+    // fraction
+    if(i < item->len && item->p[i] == '.') {
+        for(++i; i < item->len && item->p[i] >= '0' && item->p[i] <= '9'; i++, digits++) {
+            if(mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + (item->p[i] - '0');
+                --exponent;
+            }
+        }
+    }
+    
+    if(digits == 0) {
+        return -1;
+    }
+    
+    // exponent
+    if(i < item->len && (item->p[i] == 'e' || item->p[i] == 'E')) {
+        int e   = 0;
+        int neg = 0;
+        
+        ++i;
+        
+        if(i < item->len && (item->p[i] == '-' || item->p[i] == '+')) {
+            neg = (item->p[i] == '-');
+            ++i;
+        }
+        
+        for(; i < item->len && item->p[i] >= '0' && item->p[i] <= '9'; i++) {
+            if(e <= -SCAN_EXPONENT_MIN) {                   // saturate, the result is decided anyway
+                e = e * 10 + (item->p[i] - '0');
+            }
+        }
+        
+        exponent += neg ? -e : e;
+    }
+    
+    if(exponent > SCAN_EXPONENT_MAX) {
+        exponent = SCAN_EXPONENT_MAX;
+    } else if(exponent < SCAN_EXPONENT_MIN) {
+        exponent = SCAN_EXPONENT_MIN;
+    }
+    
+    v = (double) mantissa;
+    
+    for(; exponent > 0; exponent--) {
+        v *= 10.0;
+    }
+    for(; exponent < 0; exponent++) {
+        v /= 10.0;
+    }
+    
+    *value = negative ? -v : v;
+    
+    return 0;
+}
+/**
+ * Accepts true/false as well as numbers (non-zero is true)
+ * @param item
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanBool(JSON_ITEM* item, bool* value)
+{
+    double v;
+    
+    switch(item->kind) {
+        case JsonTrue:
+            *value = true;
+            return 0;
+            
+        case JsonFalse:
+            *value = false;
+            return 0;
+            
+        case JsonNumber:
+            if(scanDouble(item, &v) != 0) {
+                return -1;
+            }
+            
+            *value = (v != 0.0);
+            return 0;
+            
+        default:
+            return -1;
+    }
+}
+
+/******************************************************************************************************************
+ * private functions
+ *
+ */
+
+/**
+ * 
+ * @param s
+ */
+void ICACHE_FLASH_ATTR skipWhitespace(JSON_SCAN* s)
+{
+    while(s->p < s->end && (*s->p == ' ' || *s->p == '\t' || *s->p == '\n' || *s->p == '\r')) {
+        ++s->p;
+    }
+}
+/**
+ * 
+ * @param s
+ * @param item
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanItem(JSON_SCAN* s, JSON_ITEM* item)
+{
+    skipWhitespace(s);
+    
+    if(s->p >= s->end) {
+        return -1;
+    }
+    
+    item->p       = s->p;
+    item->len     = 0;
+    item->escaped = 0;
+    
+    switch(*s->p) {
+        case '"':
+            item->kind = JsonString;
+            item->p    = ++s->p;
+            
+            while(s->p < s->end && *s->p != '"') {
+                if(*s->p == '\\') {
+                    item->escaped = 1;
+                    ++s->p;
+                }
+                
+                ++s->p;
+            }
+            
+            if(s->p >= s->end) {
+                return -1;
+            }
+            
+            item->len = s->p - item->p;
+            *s->p++   = '\0';           // terminate in place of the closing quote
+            return 0;
+            
+        case '{':
+            item->kind = JsonObject;    // not consumed
+            return 0;
+            
+        case '[':
+            item->kind = JsonArray;     // not consumed
+            return 0;
+            
+        case 't':
+            item->kind = JsonTrue;
+            return scanLiteral(s, "true", 4);
+            
+        case 'f':
+            item->kind = JsonFalse;
+            return scanLiteral(s, "false", 5);
+            
+        case 'n':
+            item->kind = JsonNull;
+            return scanLiteral(s, "null", 4);
+            
+        default:
+            if(*s->p != '-' && (*s->p < '0' || *s->p > '9')) {
+                DTXT("scanItem(): unexpected '%c'\n", *s->p);
+                return -1;
+            }
+            
+            item->kind = JsonNumber;
+            
+            while(s->p < s->end && ((*s->p >= '0' && *s->p <= '9') || *s->p == '-' || *s->p == '+' || *s->p == '.' || *s->p == 'e' || *s->p == 'E')) {
+                ++s->p;
+            }
+            
+            item->len = s->p - item->p;
+            return 0;
+    }
+}
+/**
+ * 
+ * @param s
+ * @param literal
+ * @param len
+ * @return 
+ */
+int ICACHE_FLASH_ATTR scanLiteral(JSON_SCAN* s, const char* literal, int len)
+{
+    if(s->end - s->p < len || os_strncmp(s->p, literal, len) != 0) {
+        return -1;
+    }
+    
+    s->p += len;
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR hexValue(char c)
+{
+    if(c >= '0' && c <= '9') {
+        return c - '0';
+    } else if(c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if(c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    
+    return -1;
+}
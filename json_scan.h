@@ -0,0 +1,163 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef JSON_SCAN_H
+#define	JSON_SCAN_H
+
+#include <github.com/mikejac/misc.esp8266-nonos.cpp/espmissingincludes.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************************************************
+ * 
+ * Reentrant, allocation-free JSON scanner working in place on a writable buffer (strings are zero-terminated and 
+ * unescaped inside the buffer itself). All state lives in the JSON_SCAN; nothing is global.
+ * 
+ * Nested objects and arrays returned by scanMember()/scanElement() are not consumed - the caller must either 
+ * descend into them with scanObject()/scanArray() or step over them with scanSkip().
+ *
+ */
+
+typedef enum {
+    JsonNone,
+    JsonString,
+    JsonNumber,
+    JsonTrue,
+    JsonFalse,
+    JsonNull,
+    JsonObject,
+    JsonArray
+} JSON_KIND;
+
+typedef struct {
+    JSON_KIND   kind;
+    char*       p;              // first character; strings are zero-terminated
+    int         len;
+    int         escaped;        // string still contains escape sequences, see scanString()
+} JSON_ITEM;
+
+typedef struct {
+    char*       p;
+    char*       end;
+} JSON_SCAN;
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param s
+ * @param json
+ * @param len
+ * @return 
+ */
+int scanBegin(JSON_SCAN* s, char* json, int len);
+/**
+ * Enters the object at the current position
+ * @param s
+ * @return 
+ */
+int scanObject(JSON_SCAN* s);
+/**
+ * 
+ * @param s
+ * @param name
+ * @param item
+ * @return 0 = member found, 1 = end of object, -1 = error
+ */
+int scanMember(JSON_SCAN* s, const char** name, JSON_ITEM* item);
+/**
+ * Enters the array at the current position
+ * @param s
+ * @return 
+ */
+int scanArray(JSON_SCAN* s);
+/**
+ * 
+ * @param s
+ * @param item
+ * @return 0 = element found, 1 = end of array, -1 = error
+ */
+int scanElement(JSON_SCAN* s, JSON_ITEM* item);
+/**
+ * Reads a bare value - a message that is just a string, number or literal
+ * @param s
+ * @param item
+ * @return 
+ */
+int scanValue(JSON_SCAN* s, JSON_ITEM* item);
+/**
+ * Steps over a nested object or array; does nothing for other items
+ * @param s
+ * @param item
+ * @return 
+ */
+int scanSkip(JSON_SCAN* s, JSON_ITEM* item);
+/**
+ * Unescapes a string item in place
+ * @param item
+ * @return the zero-terminated string or 0 if the item is not a string
+ */
+const char* scanString(JSON_ITEM* item);
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int scanInt64(JSON_ITEM* item, sint64_t* value);
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int scanUInt64(JSON_ITEM* item, uint64_t* value);
+/**
+ * 
+ * @param item
+ * @param value
+ * @return 
+ */
+int scanDouble(JSON_ITEM* item, double* value);
+/**
+ * Accepts true/false as well as numbers (non-zero is true)
+ * @param item
+ * @param value
+ * @return 
+ */
+int scanBool(JSON_ITEM* item, bool* value);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* JSON_SCAN_H */
+
@@ -27,6 +27,9 @@
 #include "mqtt_connector.h"
 #include "topics.h"
 #include "service_device.h"
+#include "flash_strings.h"
+#include "json_scan.h"
+#include "number_format.h"
 #include <github.com/mikejac/date_time.esp8266-nonos.cpp/system_time.h>
 #include <github.com/mikejac/wifi.esp8266-nonos.cpp/wifi.h>
 #include <github.com/mikejac/bluemix.esp8266-nonos.cpp/bluemix.h>
@@ -37,10 +40,38 @@
 #define DTXT(...)   os_printf(__VA_ARGS__)
 //#define DTXT(...)
 
-#define classTypeDeviceTxt		"device"
-#define classTypeControllerTxt		"controller"
-#define classTypeDeviceSvcTxt 		"device_svc"
-#define classTypeControllerSvcTxt	"controller_svc"
+#define CLASS_TYPE_SIZE                 16
+
+// class names, indexed by ClassType
+static const char classTypeTxt[][CLASS_TYPE_SIZE] FLASH_STR_ATTR = {
+    "",
+    "device",
+    "controller",
+    "device_svc",
+    "controller_svc"
+};
+
+#define classTypeDeviceTxt		classTypeTxt[ClassTypeDevice]
+#define classTypeControllerTxt		classTypeTxt[ClassTypeController]
+#define classTypeDeviceSvcTxt 		classTypeTxt[ClassTypeDeviceSvc]
+#define classTypeControllerSvcTxt	classTypeTxt[ClassTypeControllerSvc]
+
+// a status message as decoded by unmarshalStatusMembers(), taken over by the peer only once it is complete
+typedef struct {
+    fabricStatus        Status;
+    sint64_t            Uptime;
+    ClassType           Class;
+    const char*         PlatformId;         // points into the decoded message
+} PeerStatus;
+
+#define STATUS_FMT_SIZE                 160
+// worst case PUBLISH header around topic and payload: fixed header (5), topic length (2) and packet id (2)
+#define MQTT_PUBLISH_OVERHEAD           (5 + 2 + 2)
+#define STATUS_UPTIME_WIDTH             10      // uint32_t seconds; padded with spaces, which JSON allows
+
+static const char statusOnlineFmt[] FLASH_STR_ATTR       = "{\"d\":{\"_type\":\"status\",\"status\":\"online\",\"uptime\":%s,\"nodename\":\"%s\",\"platform_id\":\"%s\",\"class\":\"%s\"}}";
+static const char statusOfflineFmt[] FLASH_STR_ATTR      = "{\"d\":{\"_type\":\"status\",\"status\":\"offline\",\"uptime\":%s,\"nodename\":\"%s\",\"platform_id\":\"%s\",\"class\":\"%s\"}}";
+static const char statusDisconnectedFmt[] FLASH_STR_ATTR = "{\"d\":{\"_type\":\"status\",\"status\":\"disconnected\",\"uptime\":null,\"nodename\":\"%s\",\"platform_id\":\"%s\",\"class\":\"%s\"}}";
 
 #define fabricStatusQos                 0 // 2
 #define fabricStatusRetain              1
@@ -58,6 +89,7 @@ typedef enum {
     connect,
     disconnect,
     svcCtrlOnline,
+    svcCtrlOffline,
     svcFromHK
 } MqttFabric_MessageType;
 
@@ -83,6 +115,10 @@ typedef struct {
     char* feed_id;      // format
 } MqttFabric_MessageFromHk;
 
+typedef struct {
+    char* nodename;     // the controllers nodename
+} MqttFabric_MessageCtrl;
+
 #define MqttFabric_GetOfframp_Nodename(m)           (m->m_Message.m_MessageOfframp.nodename)
 #define MqttFabric_GetOfframp_ActorId(m)            (m->m_Message.m_MessageOfframp.actor_id)
 #define MqttFabric_GetOfframp_ActorPlatformId(m)    (m->m_Message.m_MessageOfframp.actor_platform_id)
@@ -103,6 +139,9 @@ typedef struct {
 #define MqttFabric_GetFromHK_ActorId(m)             (m->m_Message.m_MessageFromHK.actor_id)
 #define MqttFabric_GetFromHK_FeedId(m)              (m->m_Message.m_MessageFromHK.feed_id)
 #define MqttFabric_GetFromHK_Payload(m)             (m->m_Payload)
+#define MqttFabric_GetFromHK_PayloadLen(m)          (m->m_PayloadLen)
+
+#define MqttFabric_GetCtrl_Nodename(m)              (m->m_Message.m_MessageCtrl.nodename)
 
 typedef struct MqttFabric_Message MqttFabric_Message;
 
@@ -115,6 +154,7 @@ struct MqttFabric_Message {
         MqttFabric_MessageOfframp m_MessageOfframp;
         MqttFabric_MessageCommand m_MessageCommand;
         MqttFabric_MessageFromHk  m_MessageFromHK;
+        MqttFabric_MessageCtrl    m_MessageCtrl;
     } m_Message;
     
     char*    m_Payload;
@@ -210,14 +250,26 @@ static void onOfframpHandler(   Mqtt*                   mqtt,
                                 int                     payloadlen);
 /**
  * 
+ * @param classType
+ * @return 1 if 'classType' has an entry in classTypeTxt
+ */
+static int classTypeValid(ClassType classType);
+/**
+ * Builds the status message template for 'status'
  * @param mqtt
- * @param fabricStatus
- * @param seconds
- * @param topic
- * @param msg
+ * @param status
  * @return 
  */
-static int statusMessage(Mqtt* mqtt, fabricStatus fabricStatus, int seconds, char** topic, char** msg);
+static int statusTemplate(Mqtt* mqtt, fabricStatus status);
+/**
+ * Patches the uptime into the status message template for 'status'
+ * @param mqtt
+ * @param status
+ * @param seconds
+ * @param len
+ * @return the message
+ */
+static const char* statusMessage(Mqtt* mqtt, fabricStatus status, int seconds, int* len);
 /**
  * 
  * @param mqtt
@@ -230,6 +282,58 @@ static void chronosSubscribe(Mqtt* mqtt);
  * @return 
  */
 static char* strcpy_alloc(char** dest, const char* source);
+/**
+ * 
+ * @param mqtt
+ * @param nodename
+ * @param payload
+ * @param payloadlen
+ */
+static void peerStatus(Mqtt* mqtt, const char* nodename, const unsigned char* payload, int payloadlen);
+/**
+ * 
+ * @param s
+ * @param m
+ * @param envelope
+ * @return 
+ */
+static int unmarshalStatusMembers(JSON_SCAN* s, PeerStatus* m, int envelope);
+/**
+ * 
+ * @param mqtt
+ */
+static void peerEvict(Mqtt* mqtt);
+/**
+ * 
+ * @param data
+ * @param len
+ * @return 
+ */
+static uint32_t payloadHash(const unsigned char* data, int len);
+/**
+ * 
+ * @param mqtt
+ * @param nodename
+ * @param taskId
+ * @param serviceId
+ * @param feedId
+ * @param data
+ * @param len
+ * @param qos
+ * @param retain
+ * @return 
+ */
+static int offrampPublish(Mqtt* mqtt, const char* nodename, const char* taskId, const char* serviceId, const char* feedId, const char* data, int len, int qos, int retain);
+/**
+ * 
+ * @param mqtt
+ * @param nodename
+ * @param taskId
+ * @param serviceId
+ * @param feedId
+ * @return the size of the offramp topic, the longest one for NodenameControllers
+ */
+static int offrampTopicSize(Mqtt* mqtt, const char* nodename, const char* taskId, const char* serviceId, const char* feedId);
 /**
  * 
  * @param name
@@ -277,12 +381,70 @@ Mqtt* ICACHE_FLASH_ATTR Connector(MqttOptions* options) {
 
     mqtt->port      = options->Port;
     mqtt->classType = options->ClassType;
+    
+    // it indexes classTypeTxt
+    if(!classTypeValid(mqtt->classType)) {
+        DTXT("Connector(): invalid class type %d\n", (int) mqtt->classType);
+        goto defer;
+    }
+
+    if(options->StatusByClass) {
+        char class_type[CLASS_TYPE_SIZE];
+        
+        if(strcpy_alloc(&mqtt->statusClass, flashStrcpy(class_type, classTypeTxt[mqtt->classType], sizeof(class_type))) == 0) {
+            goto defer;
+        }
+        
+        // devices only react to service controllers, controllers want to hear from everyone
+        if(mqtt->classType == ClassTypeDevice || mqtt->classType == ClassTypeDeviceSvc) {
+            flashStrcpy(class_type, classTypeControllerSvcTxt, sizeof(class_type));
+        } else {
+            strcpy(class_type, fabricTopicAny);
+        }
+        
+        if(strcpy_alloc(&mqtt->statusFilter, class_type) == 0) {
+            goto defer;
+        }
+    }
+    
+    if(options->CompactTopics) {
+        char alias[12];
+        
+        mqtt->compactTopics = 1;
+        
+        if(options->NodenameAlias != 0) {
+            os_sprintf(alias, "%d", options->NodenameAlias);
+            
+            if(strcpy_alloc(&mqtt->nodenameAlias, alias) == 0) {
+                goto defer;
+            }
+        }
+        if(options->PlatformIdAlias != 0) {
+            os_sprintf(alias, "%d", options->PlatformIdAlias);
+            
+            if(strcpy_alloc(&mqtt->platformIdAlias, alias) == 0) {
+                goto defer;
+            }
+        }
+    }
+
+    // messages are encoded straight into the packet buffer; it's allocated by the first OfframpReserve()
+    mqtt->packetSize = options->BufferSize;
 
     STAILQ_INIT(&mqttHead);                     // initialize the queue
     
-    // create last-will-and-testament topic and message
-    char* lwt_topic; char* lwt_msg;
-    if(statusMessage(mqtt, fabricStatusDisconnected, 0, &lwt_topic, &lwt_msg) != 0) {
+    // status topic and messages; they only change in the uptime so they're built once
+    mqtt->statusTopic = (char*) os_malloc(topicStatusPublish(mqtt, 0));
+    if(mqtt->statusTopic == 0) {
+        DTXT("Connector(2): mem error\n");
+        goto defer;
+    }
+    
+    topicStatusPublish(mqtt, mqtt->statusTopic);
+    
+    if(statusTemplate(mqtt, fabricStatusOnline) != 0 || 
+       statusTemplate(mqtt, fabricStatusOffline) != 0 || 
+       statusTemplate(mqtt, fabricStatusDisconnected) != 0) {
         goto defer;
     }
     
@@ -293,9 +455,10 @@ Mqtt* ICACHE_FLASH_ATTR Connector(MqttOptions* options) {
                         mqtt,                   // user data
                         options->BufferSize);
     
+    // the last-will-and-testament
     MQTT_InitLWT(&mqtt->client, 
-                lwt_topic,                      // topic
-                lwt_msg,                        // message
+                mqtt->statusTopic,              // topic
+                mqtt->status[fabricStatusDisconnected].msg, // message
                 fabricStatusQos,                // QoS
                 fabricStatusRetain);            // retain
 
@@ -310,11 +473,19 @@ Mqtt* ICACHE_FLASH_ATTR Connector(MqttOptions* options) {
 defer:
     DTXT("Connector(): defer!\n");
 
-    if(lwt_topic) {
-        os_free(lwt_topic);
+    for(int i = 0; i <= fabricStatusDisconnected; i++) {
+        if(mqtt->status[i].msg) {
+            os_free(mqtt->status[i].msg);
+        }
+    }
+    if(mqtt->statusTopic) {
+        os_free(mqtt->statusTopic);
     }
-    if(lwt_msg) {
-        os_free(lwt_msg);
+    if(mqtt->packet) {
+        os_free(mqtt->packet);
+    }
+    if(mqtt->server) {
+        os_free(mqtt->server);
     }
     if(mqtt->rootTopic) {
         os_free(mqtt->rootTopic);
@@ -325,6 +496,18 @@ defer:
     if(mqtt->actorPlatformId) {
         os_free(mqtt->actorPlatformId);
     }
+    if(mqtt->statusClass) {
+        os_free(mqtt->statusClass);
+    }
+    if(mqtt->statusFilter) {
+        os_free(mqtt->statusFilter);
+    }
+    if(mqtt->nodenameAlias) {
+        os_free(mqtt->nodenameAlias);
+    }
+    if(mqtt->platformIdAlias) {
+        os_free(mqtt->platformIdAlias);
+    }
 
     os_free(mqtt);
 
@@ -346,16 +529,10 @@ int ICACHE_FLASH_ATTR Close(Mqtt* mqtt)
             DTXT("Close(): connected, send status message and disconnect\n");
             
             // send status message
-            char* topic; char* msg;
-            if(statusMessage(mqtt, fabricStatusOffline, (int) esp_uptime(0), &topic, &msg) == 0) {
-                MQTT_Publish(&mqtt->client, topic, msg, os_strlen(msg), fabricStatusQos, fabricStatusRetain);
-            }
-            if(topic != 0) {
-                os_free(topic);
-            }
-            if(msg != 0) {
-                os_free(msg);
-            }
+            int         len;
+            const char* msg = statusMessage(mqtt, fabricStatusOffline, (int) esp_uptime(0), &len);
+            
+            MQTT_Publish(&mqtt->client, mqtt->statusTopic, msg, len, fabricStatusQos, fabricStatusRetain);
 
             // also send disconnect
             MQTT_Disconnect(&mqtt->client);
@@ -484,30 +661,47 @@ int ICACHE_FLASH_ATTR ConnectorRun(Mqtt* mqtt)
             }
             
             if(mqtt->svcDevice != 0) {
-                deviceSubscribe(mqtt->svcDevice);
-                devicePublish(mqtt->svcDevice);
+                deviceConnected(mqtt->svcDevice);
             } 
             break;
             
         case disconnect:
             ret = RUN_DISCONNECTED;
+            
+            if(mqtt->svcDevice != 0) {
+                deviceDisconnected(mqtt->svcDevice);
+            } 
             break;
             
         case svcCtrlOnline:
             if(mqtt->svcDevice != 0) {
-                devicePublish(mqtt->svcDevice);
+                deviceControllerStatus(mqtt->svcDevice, MqttFabric_GetCtrl_Nodename(msg), 1);
+            } 
+            break;
+            
+        case svcCtrlOffline:
+            if(mqtt->svcDevice != 0) {
+                deviceControllerStatus(mqtt->svcDevice, MqttFabric_GetCtrl_Nodename(msg), 0);
             } 
             break;
             
         case svcFromHK:
             DTXT("ConnectorRun(): event svcFromHK; actorId = '%s', feedId = '%s'\n", MqttFabric_GetFromHK_ActorId(msg), MqttFabric_GetFromHK_FeedId(msg));
-            onValueUpdate(mqtt->svcDevice, MqttFabric_GetFromHK_ActorId(msg), MqttFabric_GetFromHK_FeedId(msg), MqttFabric_GetFromHK_Payload(msg));
+            onValueUpdate(  mqtt->svcDevice, 
+                            MqttFabric_GetFromHK_ActorId(msg), 
+                            MqttFabric_GetFromHK_FeedId(msg), 
+                            MqttFabric_GetFromHK_Payload(msg), 
+                            MqttFabric_GetFromHK_PayloadLen(msg) - 1);      // without the terminating zero
             break;
     }
     
     // delete event data
     DeleteEvent(msg);    
     
+    if(mqtt->svcDevice != 0) {
+        deviceRun(mqtt->svcDevice);
+    }
+    
     return ret;
 }
 /**
@@ -546,6 +740,22 @@ int ICACHE_FLASH_ATTR EnableChronos(Mqtt* mqtt, const char* chronosNodename)
     
     return 0;
 }
+/**
+ * 
+ * @param mqtt
+ * @param enable
+ * @return 
+ */
+int ICACHE_FLASH_ATTR EnableUnicast(Mqtt* mqtt, int enable)
+{
+    if(mqtt == 0) {
+        return -1;
+    }
+
+    mqtt->unicast = enable;
+    
+    return 0;
+}
 /**
  * 
  * @param mqtt
@@ -659,37 +869,165 @@ int ICACHE_FLASH_ATTR DebugPublish(Mqtt* mqtt, const char* feedId, const char* d
         return -1;
     }
 
-    if(mqtt->shutdown == 0) {
-        char* topic = (char*) os_malloc(topicOfframpPublish(mqtt, 
-                                                            fabricNodenameBroadcast,		// destination nodename 
-                                                            fabricTaskIdDebug, 			// taskId 
-                                                            GetPlatformId(mqtt),		// platformId
-                                                            fabricServiceIdDebug,               // serviceId 
-                                                            feedId,
-                                                            0));
+    return OfframpPublish(mqtt, fabricNodenameBroadcast, fabricTaskIdDebug, fabricServiceIdDebug, feedId, data, os_strlen(data), 0, 0);
+}
+/**
+ * 
+ * @param mqtt
+ * @param nodename
+ * @param taskId
+ * @param serviceId
+ * @param feedId
+ * @param data
+ * @param len
+ * @param qos
+ * @param retain
+ * @return 
+ */
+int ICACHE_FLASH_ATTR OfframpPublish(Mqtt* mqtt, const char* nodename, const char* taskId, const char* serviceId, const char* feedId, const char* data, int len, int qos, int retain)
+{
+    if(mqtt == 0) {
+        return -1;
+    }
 
-        if(topic == 0) {
-            DTXT("DebugPublish(topic): mem fail\n");
+    if(mqtt->shutdown != 0) {
+        return 0;
+    }
+    
+    if(nodename != NodenameControllers) {
+        return offrampPublish(mqtt, nodename, taskId, serviceId, feedId, data, len, qos, retain);
+    }
+    
+    int count = 0;
+    int ret   = 0;
+    
+    if(mqtt->unicast) {
+        for(Peer* p = mqtt->peers; p != 0; p = p->next) {
+            if(p->Class == ClassTypeControllerSvc && p->Status == fabricStatusOnline) {
+                if(offrampPublish(mqtt, p->Nodename, taskId, serviceId, feedId, data, len, qos, retain) != 0) {
+                    ret = -1;
+                }
+                
+                count++;
+            }
+        }
+    }
+    
+    if(count == 0) {
+        ret = offrampPublish(mqtt, fabricNodenameBroadcast, taskId, serviceId, feedId, data, len, qos, retain);
+    }
+    
+    return ret;
+}
+/**
+ * 
+ * @param mqtt
+ * @param nodename
+ * @param taskId
+ * @param serviceId
+ * @param feedId
+ * @param packet
+ * @return 
+ */
+int ICACHE_FLASH_ATTR OfframpReserve(Mqtt* mqtt, const char* nodename, const char* taskId, const char* serviceId, const char* feedId, MqttPacket* packet)
+{
+    if(mqtt == 0 || mqtt->packetSize <= 0) {
+        return -1;
+    }
+    
+    if(mqtt->packetUsed != 0) {
+        DTXT("OfframpReserve(): busy\n");
+        return -1;
+    }
+    
+    // only nodes which encode in place (a service device) pay for the buffer
+    if(mqtt->packet == 0) {
+        mqtt->packet = (char*) os_malloc(mqtt->packetSize);
+        if(mqtt->packet == 0) {
+            DTXT("OfframpReserve(): mem fail\n");
             return -1;
         }
-
-        topicOfframpPublish(mqtt, 
-                            fabricNodenameBroadcast,		// destination nodename 
-                            fabricTaskIdDebug, 			// taskId 
-                            GetPlatformId(mqtt),		// platformId
-                            fabricServiceIdDebug,               // serviceId 
-                            feedId,
-                            topic);
-
-        DTXT("DebugPublish(): topic = '%s'\n", topic);
-        
-        MQTT_Publish(&mqtt->client, topic, data, os_strlen(data), 0, 0);
+    }
+    
+    // the payload goes first, the topic is written behind it by offrampPublish(); what's left has to fit in a PUBLISH 
+    // packet of the client, which has a buffer of the same size
+    packet->Payload   = mqtt->packet;
+    packet->Size      = mqtt->packetSize - MQTT_PUBLISH_OVERHEAD - offrampTopicSize(mqtt, nodename, taskId, serviceId, feedId);
+    packet->nodename  = nodename;
+    packet->taskId    = taskId;
+    packet->serviceId = serviceId;
+    packet->feedId    = feedId;
+    
+    if(packet->Size <= 0) {
+        DTXT("OfframpReserve(): topic too long\n");
+        return -1;
+    }
+    
+    mqtt->packetUsed = packet->Size;
+    
+    return 0;
+}
+/**
+ * 
+ * @param mqtt
+ * @param packet
+ * @param len
+ * @param qos
+ * @param retain
+ * @return 
+ */
+int ICACHE_FLASH_ATTR OfframpCommit(Mqtt* mqtt, MqttPacket* packet, int len, int qos, int retain)
+{
+    int ret = -1;
+    
+    if(mqtt == 0 || mqtt->packetUsed == 0) {
+        return -1;
+    }
+    
+    if(len >= 0 && len <= packet->Size) {
+        mqtt->packetUsed = len;
         
-        os_free(topic);
+        ret = OfframpPublish(mqtt, packet->nodename, packet->taskId, packet->serviceId, packet->feedId, packet->Payload, len, qos, retain);
+    }
+    
+    mqtt->packetUsed = 0;
+    
+    return ret;
+}
+/**
+ * 
+ * @param mqtt
+ * @param nodename
+ * @return 
+ */
+Peer* ICACHE_FLASH_ATTR FindPeer(Mqtt* mqtt, const char* nodename)
+{
+    for(Peer* p = mqtt->peers; p != 0; p = p->next) {
+        if(os_strcmp(p->Nodename, nodename) == 0) {
+            return p;
+        }
     }
     
     return 0;
 }
+/**
+ * 
+ * @param mqtt
+ * @return 
+ */
+Peer* ICACHE_FLASH_ATTR FirstPeer(Mqtt* mqtt)
+{
+    return mqtt->peers;
+}
+/**
+ * 
+ * @param p
+ * @return 
+ */
+Peer* ICACHE_FLASH_ATTR NextPeer(Peer* p)
+{
+    return (p != 0) ? p->next : 0;
+}
 /**
  * 
  * @param client
@@ -762,7 +1100,14 @@ void ICACHE_FLASH_ATTR DeleteEvent(MqttFabric_Message* msg)
             
         case connect:
         case disconnect:
+            STAILQ_REMOVE(&mqttHead, msg, MqttFabric_Message, entries);            
+            os_free(msg);
+            break;
+            
         case svcCtrlOnline:
+        case svcCtrlOffline:
+            if(msg->m_Message.m_MessageCtrl.nodename)               os_free(msg->m_Message.m_MessageCtrl.nodename);
+            
             STAILQ_REMOVE(&mqttHead, msg, MqttFabric_Message, entries);            
             os_free(msg);
             break;
@@ -801,25 +1146,19 @@ void ICACHE_FLASH_ATTR onConnect(unsigned char sessionPresent, unsigned char con
     }
 
     // send status message
-    char* topic1; char* msg;
-    if(statusMessage(mqtt, fabricStatusOnline, (int) esp_uptime(0), &topic1, &msg) == 0) {
-        MQTT_Publish(&mqtt->client, topic1, msg, os_strlen(msg), fabricStatusQos, fabricStatusRetain);
-    }
+    int         len;
+    const char* msg = statusMessage(mqtt, fabricStatusOnline, (int) esp_uptime(0), &len);
+    
+    MQTT_Publish(&mqtt->client, mqtt->statusTopic, msg, len, fabricStatusQos, fabricStatusRetain);
 
     // create status message topic
-    char* topic2 = (char*) os_malloc(topicStatusSubscribe(mqtt, 0));
-    topicStatusSubscribe(mqtt, topic2);
+    char* topic = (char*) os_malloc(topicStatusSubscribe(mqtt, 0));
+    if(topic != 0) {
+        topicStatusSubscribe(mqtt, topic);
 
-    MQTT_Subscribe(&mqtt->client, topic2, fabricStatusQos);
+        MQTT_Subscribe(&mqtt->client, topic, fabricStatusQos);
     
-    if(topic2 != 0) {
-        os_free(topic2);
-    }
-    if(topic1 != 0) {
-        os_free(topic1);
-    }
-    if(msg != 0) {
-        os_free(msg);
+        os_free(topic);
     }
 
     // append to queue
@@ -873,6 +1212,9 @@ void ICACHE_FLASH_ATTR onMessage(const char* topic, const unsigned char* payload
     char* platformId        = NULL;
     char* serviceId         = NULL;
     char* feedId            = NULL;
+    char* iid               = NULL;
+    char* format            = NULL;
+    char  addressed[3 * SUBTOPIC_SIZE];
     
     int   idx;
 
@@ -883,6 +1225,11 @@ void ICACHE_FLASH_ATTR onMessage(const char* topic, const unsigned char* payload
         char* subtopic;
 
         while(tokenNext(&token, &subtopic, &idx) == 0) {
+            if(idx >= 2) {
+                // back from the compact topic layout
+                subtopic = (char*) topicTokenExpand(mqtt, subtopic);
+            }
+            
             switch(idx) {
                 case 0:
                     if(os_strcmp(mqtt->rootTopic, subtopic) != 0) {
@@ -896,7 +1243,7 @@ void ICACHE_FLASH_ATTR onMessage(const char* topic, const unsigned char* payload
                     break;
                     
                 case 2:
-                    if(os_strcmp("$feeds", subtopic) == 0 || os_strcmp("$commands", subtopic) == 0) {
+                    if(os_strcmp(fabricFeeds, subtopic) == 0 || os_strcmp(fabricCommands, subtopic) == 0) {
 
                     } else {
                         DTXT("onMessage(): '$feeds' or '$commands' missing; '%s'\n", subtopic);
@@ -905,13 +1252,13 @@ void ICACHE_FLASH_ATTR onMessage(const char* topic, const unsigned char* payload
                     break;
                     
                 case 3:
-                    if(os_strcmp("$offramp", subtopic) == 0) {
+                    if(os_strcmp(fabricOfframp, subtopic) == 0) {
                         DTXT("onMessage(): '$offramp'\n");
                         ramp = offramp;
-                    } else if(os_strcmp("$onramp", subtopic) == 0) {
+                    } else if(os_strcmp(fabricOnramp, subtopic) == 0) {
                         DTXT("onMessage(): '$onramp'\n");
                         ramp = onramp;
-                    } else if(os_strcmp("$clients", subtopic) == 0) {
+                    } else if(os_strcmp(fabricClients, subtopic) == 0) {
                         DTXT("onMessage(): '$clients'\n");
                         ramp = command;
                     } else {
@@ -947,6 +1294,7 @@ void ICACHE_FLASH_ATTR onMessage(const char* topic, const unsigned char* payload
                     if(ramp == offramp) {
                         platformId = subtopic;
                     }
+                    // with StatusByClass a status topic ends with the class of the sender - the payload has it too
                     break;
                     
                 case 8:
@@ -960,17 +1308,41 @@ void ICACHE_FLASH_ATTR onMessage(const char* topic, const unsigned char* payload
                         feedId = subtopic;
                     }
                     break;
+                    
+                // addressed value feeds; <aid>/<iid>/<format>
+                case 10:
+                    if(ramp == offramp) {
+                        iid = subtopic;
+                    }
+                    break;
+                    
+                case 11:
+                    if(ramp == offramp) {
+                        format = subtopic;
+                    }
+                    break;
             }
         }
     }
 
+    if(format != 0) {
+        // the handlers see the address as one feedId
+        if(os_strlen(feedId) + os_strlen(iid) + os_strlen(format) + 3 > sizeof(addressed)) {
+            DTXT("onMessage(): address too long\n");
+            return;
+        }
+        
+        os_sprintf(addressed, "%s/%s/%s", feedId, iid, format);
+        feedId = addressed;
+    }
+    
     if(ramp == command) {
         DTXT("onMessage(): $commands\n");
         DTXT("onMessage(): nodename          = %s\n", nodename);
         DTXT("onMessage(): platformId        = %s\n", platformId);
         DTXT("onMessage(): feedId            = %s\n", feedId);
         
-        if(os_strcmp(nodename, mqtt->actorId) != 0) {
+        if(os_strcmp(nodename, topicNodename(mqtt)) != 0) {
             onCommandHandler(   mqtt, 
                                 nodename, 
                                 actorId, 
@@ -996,7 +1368,7 @@ void ICACHE_FLASH_ATTR onMessage(const char* topic, const unsigned char* payload
         DTXT("onMessage(): serviceId         = %s\n", serviceId);
         DTXT("onMessage(): feedId            = %s\n", feedId);
         
-        if(os_strcmp(actorId, mqtt->actorId) != 0) {
+        if(os_strcmp(actorId, topicNodename(mqtt)) != 0) {
             onOfframpHandler(   mqtt, 
                                 nodename,
                                 actorId,
@@ -1038,38 +1410,7 @@ void ICACHE_FLASH_ATTR onCommandHandler(Mqtt*                   mqtt,
                                         int                     payloadlen)
 {
     if(os_strcmp(actorId, fabricSys) == 0 && os_strcmp(feedId, fabricCmdStatus) == 0) {
-        if(BMix_DecoderBegin((const char*)payload) != NULL) {
-            const char* _type;
-            const char* status;
-            const char* nodename;
-            const char* platformId;
-            const char* classType;
-
-            if(BMix_GetString("_type", &_type) != 0) {
-                DTXT("onCommandHandler(): '_type' not found\n");
-            } else if(BMix_GetString("status", &status) != 0) {
-                DTXT("onCommandHandler(): 'status' not found\n");
-            } else if(BMix_GetString("nodename", &nodename) != 0) {
-                DTXT("onCommandHandler(): 'nodename' not found\n");
-            } else if(BMix_GetString("platform_id", &platformId) != 0) {
-                DTXT("onCommandHandler(): 'platform_id' not found\n");
-            } else if(BMix_GetString("class", &classType) != 0) {
-                DTXT("onCommandHandler(): 'class' not found\n");
-            } else {
-                //DTXT("onCommandHandler(): all fields found\n");
-
-                if(os_strcmp(status, "online") == 0 && os_strcmp(classType, classTypeControllerSvcTxt) == 0) {
-                    DTXT("onCommandHandler(): service controller online\n");
-
-                    MqttFabric_Message* notif = os_malloc(sizeof(MqttFabric_Message));
-
-                    notif->m_MessageType = svcCtrlOnline;
-                    STAILQ_INSERT_TAIL(&mqttHead, notif, entries);                                // insert at end
-                }
-            }
-        }
-
-        BMix_DecoderEnd();
+        peerStatus(mqtt, nodename, payload, payloadlen);
     } else {
         // append to queue
         MqttFabric_Message* msg = os_malloc(sizeof(MqttFabric_Message));
@@ -1120,7 +1461,7 @@ void ICACHE_FLASH_ATTR onOfframpHandler(Mqtt*       mqtt,
                                         const unsigned char*    payload, 
                                         int                     payloadlen)
 {
-    if(os_strcmp(nodename, mqtt->actorId) == 0 && os_strcmp(taskId, fabricTaskIdService) == 0 && os_strcmp(serviceId, fabricServiceIdFromHK) == 0) {
+    if(os_strcmp(nodename, topicNodename(mqtt)) == 0 && os_strcmp(taskId, fabricTaskIdService) == 0 && os_strcmp(serviceId, fabricServiceIdFromHK) == 0) {
         DTXT("onOfframpHandler(fabricServiceIdFromHK): \n");
         
         if(mqtt->svcDevice != 0) {
@@ -1193,86 +1534,100 @@ defer:
 }
 /**
  * 
- * @param mqtt
- * @param fabricStatus
- * @param seconds
- * @param topic
- * @param msg
+ * @param classType
  * @return 
  */
-int ICACHE_FLASH_ATTR statusMessage(Mqtt* mqtt, fabricStatus fabricStatus, int seconds, char** topic, char** msg) {
-    // create the topic
-    *topic = (char*) os_malloc(topicStatusPublish(mqtt, 0));
-    topicStatusPublish(mqtt, *topic);
-
-    char class_type[16];
-    
-    switch(mqtt->classType) {
+int ICACHE_FLASH_ATTR classTypeValid(ClassType classType)
+{
+    switch(classType) {
         case ClassTypeDevice:
-            strcpy(class_type, classTypeDeviceTxt);
-            break;
-            
         case ClassTypeController:
-            strcpy(class_type, classTypeControllerTxt);
-            break;
-
         case ClassTypeDeviceSvc:
-            strcpy(class_type, classTypeDeviceSvcTxt);
-            break;
-            
         case ClassTypeControllerSvc:
-            strcpy(class_type, classTypeControllerSvcTxt);
-            break;
+            return 1;
             
         default:
-            goto defer;
+            return 0;
     }
+}
+/**
+ * 
+ * @param mqtt
+ * @param status
+ * @return 
+ */
+int ICACHE_FLASH_ATTR statusTemplate(Mqtt* mqtt, fabricStatus status)
+{
+    char        class_type[CLASS_TYPE_SIZE];
+    char        fmt[STATUS_FMT_SIZE];
+    char        uptime[STATUS_UPTIME_WIDTH + 1];
+    const char* flashFmt;
+    char*       p;
     
-    *msg = (char*) os_malloc(256);
-    if(*msg == 0) {
-        goto defer;
+    if(!classTypeValid(mqtt->classType)) {
+        DTXT("statusTemplate(): invalid class\n");
+        return -1;
     }
     
-    // create the message
-    switch(fabricStatus) {
-        case fabricStatusOnline:
-            os_sprintf(*msg, "{\"d\":{\"_type\":\"status\",\"status\":\"online\",\"uptime\":%d,\"nodename\":\"%s\",\"platform_id\":\"%s\",\"class\":\"%s\"}}", 
-                    seconds, 
-                    mqtt->actorId, 
-                    mqtt->actorPlatformId,
-                    class_type);
-            break;
-
-        case fabricStatusOffline:
-            os_sprintf(*msg, "{\"d\":{\"_type\":\"status\",\"status\":\"offline\",\"uptime\":%d,\"nodename\":\"%s\",\"platform_id\":\"%s\",\"class\":\"%s\"}}", 
-                    seconds, 
-                    mqtt->actorId, 
-                    mqtt->actorPlatformId,
-                    class_type);
-            break;
-
-        case fabricStatusDisconnected:
-            os_sprintf(*msg, "{\"d\":{\"_type\":\"status\",\"status\":\"disconnected\",\"uptime\":null,\"nodename\":\"%s\",\"platform_id\":\"%s\",\"class\":\"%s\"}}", 
-                    mqtt->actorId, 
-                    mqtt->actorPlatformId,
-                    class_type);
-            break;
+    flashStrcpy(class_type, classTypeTxt[mqtt->classType], sizeof(class_type));
+    
+    switch(status) {
+        case fabricStatusOnline:        flashFmt = statusOnlineFmt;         break;
+        case fabricStatusOffline:       flashFmt = statusOfflineFmt;        break;
+        case fabricStatusDisconnected:  flashFmt = statusDisconnectedFmt;   break;
             
         default:
-            goto defer;
+            return -1;
     }
     
-    return 0;
+    flashStrcpy(fmt, flashFmt, sizeof(fmt));
     
-defer:
-    if(*topic != 0) {
-        os_free(*topic);
+    p = (char*) os_malloc(os_strlen(fmt) + STATUS_UPTIME_WIDTH + os_strlen(mqtt->actorId) + os_strlen(mqtt->actorPlatformId) + os_strlen(class_type) + 1);
+    if(p == 0) {
+        DTXT("statusTemplate(): mem fail\n");
+        return -1;
     }
-    if(*msg != 0) {
-        os_free(*msg);
+    
+    if(status == fabricStatusDisconnected) {
+        mqtt->status[status].len    = os_sprintf(p, fmt, mqtt->actorId, mqtt->actorPlatformId, class_type);
+        mqtt->status[status].uptime = -1;
+    } else {
+        // a placeholder of the full width; statusMessage() writes the number into it
+        os_memset(uptime, ' ', STATUS_UPTIME_WIDTH);
+        uptime[STATUS_UPTIME_WIDTH] = '\0';
+        
+        mqtt->status[status].len    = os_sprintf(p, fmt, uptime, mqtt->actorId, mqtt->actorPlatformId, class_type);
+        mqtt->status[status].uptime = os_strstr(p, "\"uptime\":") - p + 9;
     }
-
-    return -1;
+    
+    mqtt->status[status].msg = p;
+    
+    return 0;
+}
+/**
+ * 
+ * @param mqtt
+ * @param status
+ * @param seconds
+ * @param len
+ * @return 
+ */
+const char* ICACHE_FLASH_ATTR statusMessage(Mqtt* mqtt, fabricStatus status, int seconds, int* len)
+{
+    StatusTemplate* t = &mqtt->status[status];
+    
+    if(t->uptime >= 0) {
+        char num[NUMBER_FORMAT_SIZE];
+        int  n = numberFormatUInt(num, (uint32_t) seconds);
+        
+        // right aligned, the leading spaces are whitespace to a JSON parser
+        os_memset(t->msg + t->uptime, ' ', STATUS_UPTIME_WIDTH - n);
+        os_memcpy(t->msg + t->uptime + STATUS_UPTIME_WIDTH - n, num, n);
+    }
+    
+    *len = t->len;
+    
+    return t->msg;
 }
 /**
  * 
@@ -1344,3 +1699,317 @@ char* ICACHE_FLASH_ATTR strcpy_alloc(char** dest, const char* source)
     
     return *dest;
 }
+/**
+ * Updates the peer directory from a status message. A payload identical to the previous one of the same node (e.g. 
+ * retained messages delivered again after a reconnect) is not decoded again
+ * @param mqtt
+ * @param nodename
+ * @param payload
+ * @param payloadlen
+ */
+void ICACHE_FLASH_ATTR peerStatus(Mqtt* mqtt, const char* nodename, const unsigned char* payload, int payloadlen)
+{
+    uint32_t   hash = payloadHash(payload, payloadlen);
+    Peer*      p    = FindPeer(mqtt, nodename);
+    PeerStatus m;
+    
+    if(p != 0 && p->hash == hash && p->len == payloadlen) {
+        DTXT("peerStatus(): '%s' unchanged\n", nodename);
+        
+        p->LastSeen = (uint32_t) esp_uptime(0);
+        return;
+    }
+    
+    // the scanner works in place, so decode a copy
+    char* msg = (char*) os_malloc(payloadlen + 1);
+    if(msg == 0) {
+        DTXT("peerStatus(msg): mem fail\n");
+        return;
+    }
+    
+    os_memcpy(msg, payload, payloadlen);
+    msg[payloadlen] = '\0';
+    
+    JSON_SCAN s;
+    
+    m.Status     = fabricStatusInvalid;
+    m.Uptime     = -1;
+    m.Class      = (p != 0) ? p->Class : ClassTypeInvalid;
+    m.PlatformId = 0;
+    
+    // a malformed message leaves the directory as it is
+    if(scanBegin(&s, msg, payloadlen) != 0 || scanObject(&s) != 0 || unmarshalStatusMembers(&s, &m, 1) != 0) {
+        DTXT("peerStatus(): malformed status from '%s'\n", nodename);
+        os_free(msg);
+        return;
+    }
+    
+    if(p == 0) {
+        if(mqtt->peerCount >= MQTT_PEERS) {
+            peerEvict(mqtt);
+        }
+        
+        p = (Peer*) os_zalloc(sizeof(Peer));
+        if(p == 0 || strcpy_alloc(&p->Nodename, nodename) == 0) {
+            DTXT("peerStatus(): mem fail\n");
+            if(p != 0) {
+                os_free(p);
+            }
+            os_free(msg);
+            return;
+        }
+        
+        p->next     = mqtt->peers;
+        mqtt->peers = p;
+        mqtt->peerCount++;
+    }
+    
+    fabricStatus prevStatus = p->Status;
+    sint64_t     prevUptime = p->Uptime;
+    
+    p->Status = m.Status;
+    p->Uptime = m.Uptime;
+    p->Class  = m.Class;
+    
+    if(m.PlatformId != 0 && (p->PlatformId == 0 || os_strcmp(p->PlatformId, m.PlatformId) != 0)) {
+        if(p->PlatformId != 0) {
+            os_free(p->PlatformId);
+            p->PlatformId = 0;
+        }
+        
+        strcpy_alloc(&p->PlatformId, m.PlatformId);
+    }
+    
+    os_free(msg);
+    
+    p->hash     = hash;
+    p->len      = payloadlen;
+    p->LastSeen = (uint32_t) esp_uptime(0);
+    
+    if(p->Class != ClassTypeControllerSvc) {
+        return;
+    }
+    
+    // a controller came online or restarted (uptime went backwards), or it went away
+    MqttFabric_MessageType type = none;
+    
+    if(p->Status == fabricStatusOnline && (prevStatus != fabricStatusOnline || p->Uptime < prevUptime)) {
+        type = svcCtrlOnline;
+    } else if(p->Status != fabricStatusOnline && prevStatus == fabricStatusOnline) {
+        type = svcCtrlOffline;
+    }
+    
+    if(type == none) {
+        return;
+    }
+    
+    DTXT("peerStatus(): service controller '%s' %s\n", nodename, (type == svcCtrlOnline) ? "online" : "offline");
+
+    MqttFabric_Message* notif = os_malloc(sizeof(MqttFabric_Message));
+    if(notif == 0) {
+        DTXT("peerStatus(notif): mem fail\n");
+        return;
+    }
+    
+    notif->m_MessageType = type;
+    
+    if(strcpy_alloc(&notif->m_Message.m_MessageCtrl.nodename, nodename) == 0) {
+        DTXT("peerStatus(nodename): mem fail\n");
+        os_free(notif);
+        return;
+    }
+    
+    STAILQ_INSERT_TAIL(&mqttHead, notif, entries);                            // insert at end
+}
+/**
+ * 
+ * @param s
+ * @param m
+ * @param envelope 1 where a "d" envelope is accepted
+ * @return 
+ */
+int ICACHE_FLASH_ATTR unmarshalStatusMembers(JSON_SCAN* s, PeerStatus* m, int envelope)
+{
+    const char* name;
+    const char* txt;
+    JSON_ITEM   item;
+    int         ret;
+    
+    while((ret = scanMember(s, &name, &item)) == 0) {
+        if(os_strcmp(name, "d") == 0 && item.kind == JsonObject) {
+            if(!envelope || scanObject(s) != 0 || unmarshalStatusMembers(s, m, 0) != 0) {
+                return -1;
+            }
+            
+            continue;
+        } else if(os_strcmp(name, "status") == 0 && (txt = scanString(&item)) != 0) {
+            if(os_strcmp(txt, "online") == 0) {
+                m->Status = fabricStatusOnline;
+            } else if(os_strcmp(txt, "offline") == 0) {
+                m->Status = fabricStatusOffline;
+            } else if(os_strcmp(txt, "disconnected") == 0) {
+                m->Status = fabricStatusDisconnected;
+            }
+        } else if(os_strcmp(name, "uptime") == 0) {
+            scanInt64(&item, &m->Uptime);                   // stays -1 for null
+        } else if(os_strcmp(name, "platform_id") == 0 && (txt = scanString(&item)) != 0) {
+            m->PlatformId = txt;
+        } else if(os_strcmp(name, "class") == 0 && (txt = scanString(&item)) != 0) {
+            m->Class = ClassTypeInvalid;
+            
+            for(int i = ClassTypeDevice; i <= ClassTypeControllerSvc; i++) {
+                if(flashStrcmp(txt, classTypeTxt[i]) == 0) {
+                    m->Class = (ClassType) i;
+                    break;
+                }
+            }
+        }
+        
+        if(scanSkip(s, &item) != 0) {
+            return -1;
+        }
+    }
+    
+    return (ret == 1) ? 0 : -1;
+}
+/**
+ * drops the node heard from least recently; online service controllers only when there is nothing else
+ * @param mqtt
+ */
+void ICACHE_FLASH_ATTR peerEvict(Mqtt* mqtt)
+{
+    uint32_t now    = (uint32_t) esp_uptime(0);
+    Peer**   victim = 0;
+    int      keep   = 1;
+    
+    for(Peer** pp = &mqtt->peers; *pp != 0; pp = &(*pp)->next) {
+        int ctrl = ((*pp)->Class == ClassTypeControllerSvc && (*pp)->Status == fabricStatusOnline);
+        
+        if(victim == 0 || ctrl < keep || (ctrl == keep && now - (*pp)->LastSeen > now - (*victim)->LastSeen)) {
+            victim = pp;
+            keep   = ctrl;
+        }
+    }
+    
+    if(victim == 0) {
+        return;
+    }
+    
+    Peer* p = *victim;
+    
+    DTXT("peerEvict(): '%s' dropped\n", p->Nodename);
+    
+    *victim = p->next;
+    mqtt->peerCount--;
+    
+    if(p->PlatformId != 0) {
+        os_free(p->PlatformId);
+    }
+    
+    os_free(p->Nodename);
+    os_free(p);
+}
+/**
+ * FNV-1a
+ * @param data
+ * @param len
+ * @return 
+ */
+uint32_t ICACHE_FLASH_ATTR payloadHash(const unsigned char* data, int len)
+{
+    uint32_t hash = 2166136261u;
+    
+    while(len-- > 0) {
+        hash ^= *data++;
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+/**
+ * 
+ * @param mqtt
+ * @param nodename
+ * @param taskId
+ * @param serviceId
+ * @param feedId
+ * @param data
+ * @param len
+ * @param qos
+ * @param retain
+ * @return 
+ */
+int ICACHE_FLASH_ATTR offrampPublish(Mqtt* mqtt, const char* nodename, const char* taskId, const char* serviceId, const char* feedId, const char* data, int len, int qos, int retain)
+{
+    char* topic;
+    int   size = topicOfframpPublish(mqtt, 
+                                     nodename,                  // destination nodename 
+                                     taskId,                    // taskId 
+                                     topicPlatformId(mqtt),     // platformId
+                                     serviceId,                 // serviceId 
+                                     feedId,
+                                     0);
+    
+    // behind the payload of a reservation, or anywhere in the packet buffer if there is none
+    int inPacket = (mqtt->packet != 0 && mqtt->packetSize - mqtt->packetUsed >= size);
+    
+    if(inPacket) {
+        topic = mqtt->packet + mqtt->packetUsed;
+    } else {
+        topic = (char*) os_malloc(size);
+        if(topic == 0) {
+            DTXT("offrampPublish(topic): mem fail\n");
+            return -1;
+        }
+    }
+
+    topicOfframpPublish(mqtt, 
+                        nodename,                               // destination nodename 
+                        taskId, 			        // taskId 
+                        topicPlatformId(mqtt),		        // platformId
+                        serviceId,                              // serviceId 
+                        feedId,
+                        topic);
+
+    DTXT("offrampPublish(): topic = '%s'\n", topic);
+
+    MQTT_Publish(&mqtt->client, topic, data, len, qos, retain);
+
+    if(!inPacket) {
+        os_free(topic);
+    }
+    
+    return 0;
+}
+/**
+ * 
+ * @param mqtt
+ * @param nodename
+ * @param taskId
+ * @param serviceId
+ * @param feedId
+ * @return 
+ */
+int ICACHE_FLASH_ATTR offrampTopicSize(Mqtt* mqtt, const char* nodename, const char* taskId, const char* serviceId, const char* feedId)
+{
+    if(nodename != NodenameControllers) {
+        return topicOfframpPublish(mqtt, nodename, taskId, topicPlatformId(mqtt), serviceId, feedId, 0);
+    }
+    
+    // any of the online service controllers, or broadcast; see OfframpPublish()
+    int size = topicOfframpPublish(mqtt, fabricNodenameBroadcast, taskId, topicPlatformId(mqtt), serviceId, feedId, 0);
+    
+    if(mqtt->unicast) {
+        for(Peer* p = mqtt->peers; p != 0; p = p->next) {
+            if(p->Class == ClassTypeControllerSvc && p->Status == fabricStatusOnline) {
+                int n = topicOfframpPublish(mqtt, p->Nodename, taskId, topicPlatformId(mqtt), serviceId, feedId, 0);
+                
+                if(n > size) {
+                    size = n;
+                }
+            }
+        }
+    }
+    
+    return size;
+}
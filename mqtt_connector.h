@@ -70,6 +70,11 @@ extern "C" {
 #define FeedIdDebugWarning              "warn"
 #define FeedIdDebugError                "err"
 
+// appended to the feedId of CBOR encoded messages
+#define FeedIdCborSuffix                ".cbor"
+// appended to the feedId of messages in a compact JSON profile
+#define FeedIdCompactSuffix             ".compact"
+
 /******************************************************************************************************************
  * 
  *
@@ -78,6 +83,14 @@ extern "C" {
 #define RUN_NO_EVENTS                   0
 #define RUN_CONNECTED                   1
 #define RUN_DISCONNECTED                2
+
+// OfframpPublish() destination: the online service controllers (see EnableUnicast()), or broadcast
+#define NodenameControllers             ((const char*) 0)
+
+// max. number of nodes in the peer directory, see FindPeer()
+#ifndef MQTT_PEERS
+#define MQTT_PEERS                      16
+#endif
     
 typedef struct Mqtt Mqtt;
 
@@ -112,6 +125,40 @@ typedef enum {
     fabricStatusDisconnected = 3
 } fabricStatus;
 
+// a publish being built in the connector's packet buffer, see OfframpReserve()
+typedef struct {
+    char*               Payload;            // write at most 'Size' bytes here
+    int                 Size;
+    
+    const char*         nodename;
+    const char*         taskId;
+    const char*         serviceId;
+    const char*         feedId;
+} MqttPacket;
+
+// a status message built once by Connector(); only the uptime field changes between publishes
+typedef struct {
+    char*               msg;
+    int                 len;
+    int                 uptime;             // offset of the space padded uptime field, -1 if there is none
+} StatusTemplate;
+
+// a node on the fabric as known from its status messages, see FindPeer()
+typedef struct Peer Peer;
+
+struct Peer {
+    char*               Nodename;
+    char*               PlatformId;
+    ClassType           Class;
+    fabricStatus        Status;
+    sint64_t            Uptime;             // -1 if unknown
+    uint32_t            LastSeen;           // esp_uptime() when its last status message arrived
+    
+    uint32_t            hash;               // of the last status payload
+    int                 len;
+    Peer*               next;
+};
+
 //
 struct Mqtt {
     // MQTT
@@ -130,12 +177,31 @@ struct Mqtt {
     char*               actorId;
     char*               actorPlatformId;
     ClassType           classType;	
+    char*               statusClass;        // class segment of our status topic, 0 if not used
+    char*               statusFilter;       // class segment of the status subscription
+    int                 compactTopics;
+    char*               nodenameAlias;      // our nodename in topics, 0 if not used
+    char*               platformIdAlias;    // our platform id in topics, 0 if not used
+    char*               statusTopic;        // our status topic
+    StatusTemplate      status[fabricStatusDisconnected + 1];   // indexed by fabricStatus; the disconnected one is the LWT
 
     // clock
     const char*         chronosNodename;
     
+    // address controllers instead of broadcast
+    int                 unicast;
+    
+    // packet buffer, see OfframpReserve()
+    char*               packet;
+    int                 packetSize;
+    int                 packetUsed;         // bytes held by an open reservation
+    
     // service
     MqttDevice*         svcDevice;
+    
+    // peer directory
+    Peer*               peers;
+    int                 peerCount;
 };
 
 /******************************************************************************************************************
@@ -177,6 +243,14 @@ int InstallCallbacks(   Mqtt*              mqtt,
  * @return 
  */
 int EnableChronos(Mqtt* mqtt, const char* chronosNodename);
+/**
+ * EnableUnicast makes messages for NodenameControllers go to each online service controller in the peer directory
+ * instead of broadcast; broadcast is still used while no controller is known
+ * @param mqtt
+ * @param enable
+ * @return 
+ */
+int EnableUnicast(Mqtt* mqtt, int enable);
 /**
  * 
  * @param mqtt
@@ -226,6 +300,62 @@ int CommandPublish(Mqtt* mqtt, const char* actorId, const char* platformId, cons
  * @return 
  */
 int DebugPublish(Mqtt* mqtt, const char* feedId, const char* data);
+/**
+ * OfframpPublish publishes on one of our offramp feeds
+ * @param mqtt
+ * @param nodename      destination nodename, fabricNodenameBroadcast or NodenameControllers
+ * @param taskId
+ * @param serviceId
+ * @param feedId
+ * @param data
+ * @param len
+ * @param qos
+ * @param retain
+ * @return 
+ */
+int OfframpPublish(Mqtt* mqtt, const char* nodename, const char* taskId, const char* serviceId, const char* feedId, const char* data, int len, int qos, int retain);
+/**
+ * OfframpReserve hands out the payload part of the connector's packet buffer (MqttOptions::BufferSize bytes) so a 
+ * message can be encoded in place; the rest of the buffer is kept for the topic. The buffer is allocated by the first 
+ * reservation. One reservation at a time, finish it with OfframpCommit()
+ * @param mqtt
+ * @param nodename      destination nodename, fabricNodenameBroadcast or NodenameControllers
+ * @param taskId
+ * @param serviceId
+ * @param feedId        must stay valid until OfframpCommit()
+ * @param packet
+ * @return 
+ */
+int OfframpReserve(Mqtt* mqtt, const char* nodename, const char* taskId, const char* serviceId, const char* feedId, MqttPacket* packet);
+/**
+ * OfframpCommit publishes the first 'len' bytes of a reservation and releases it; a negative 'len' just releases it
+ * @param mqtt
+ * @param packet
+ * @param len
+ * @param qos
+ * @param retain
+ * @return 
+ */
+int OfframpCommit(Mqtt* mqtt, MqttPacket* packet, int len, int qos, int retain);
+/**
+ * FindPeer looks up a node in the peer directory; it holds at most MQTT_PEERS nodes
+ * @param mqtt
+ * @param nodename
+ * @return 
+ */
+Peer* FindPeer(Mqtt* mqtt, const char* nodename);
+/**
+ * FirstPeer and NextPeer iterate the peer directory
+ * @param mqtt
+ * @return 
+ */
+Peer* FirstPeer(Mqtt* mqtt);
+/**
+ * 
+ * @param p
+ * @return 
+ */
+Peer* NextPeer(Peer* p);
 
 #ifdef	__cplusplus
 }
@@ -53,8 +53,12 @@ struct MqttOptions {
     ClassType       ClassType;          // What are we
     
     unsigned char   RetainStatus;
+    unsigned char   StatusByClass;      // append the class to status topics, devices then subscribe to controller status only
+    unsigned char   CompactTopics;      // use short tokens for the reserved words of the topic layout
+    int             NodenameAlias;      // with CompactTopics; our nodename in topics if not 0
+    int             PlatformIdAlias;    // with CompactTopics; our platform id in topics if not 0
     
-    int             BufferSize;
+    int             BufferSize;         // of the MQTT client and of our packet buffer, see OfframpReserve()
 };
 
 /******************************************************************************************************************
@@ -71,6 +75,10 @@ struct MqttOptions {
 #define MqttOptions_SetActorPlatformId(options, value)  options->ActorPlatformId = (char*)(value)
 #define MqttOptions_SetClassType(options, value)        options->ClassType       = (value)
 #define MqttOptions_SetBufferSize(options, value)       options->BufferSize      = (value)
+#define MqttOptions_SetStatusByClass(options, value)    options->StatusByClass   = (value)
+#define MqttOptions_SetCompactTopics(options, value)    options->CompactTopics   = (value)
+#define MqttOptions_SetNodenameAlias(options, value)    options->NodenameAlias   = (value)
+#define MqttOptions_SetPlatformIdAlias(options, value)  options->PlatformIdAlias = (value)
 
 /******************************************************************************************************************
  * prototypes
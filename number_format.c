@@ -0,0 +1,242 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#include "number_format.h"
+#include <osapi.h>
+
+#define DTXT(...)   os_printf(__VA_ARGS__)
+//#define DTXT(...)
+
+// byte accessed, so it stays in RAM even with RPCMQTT_FLASH_STRINGS
+static const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const uint32_t powersOfTen[NUMBER_DECIMALS_MAX + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * Writes the digits of 'value' backwards, ending just before 'end'
+ * @param end
+ * @param value
+ * @return the first digit
+ */
+static char* formatDigits(char* end, uint64_t value);
+
+/******************************************************************************************************************
+ * exported functions
+ *
+ */
+
+/**
+ * 
+ * @param buf
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR numberFormatInt(char* buf, sint64_t value)
+{
+    if(value < 0) {
+        buf[0] = '-';
+        
+        return numberFormatUInt(buf + 1, (uint64_t) 0 - (uint64_t) value) + 1;
+    }
+    
+    return numberFormatUInt(buf, (uint64_t) value);
+}
+/**
+ * 
+ * @param buf
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR numberFormatUInt(char* buf, uint64_t value)
+{
+    char  tmp[NUMBER_FORMAT_SIZE];
+    char* p   = formatDigits(tmp + sizeof(tmp), value);
+    int   len = tmp + sizeof(tmp) - p;
+    
+    os_memcpy(buf, p, len);
+    buf[len] = '\0';
+    
+    return len;
+}
+/**
+ * 
+ * @param buf
+ * @param value
+ * @param decimals
+ * @return 
+ */
+int ICACHE_FLASH_ATTR numberFormatFixed(char* buf, double value, int decimals)
+{
+    uint32_t scale;
+    uint64_t scaled;
+    double   v;
+    char*    p = buf;
+    int      i;
+    
+    if(decimals < 0) {
+        decimals = 0;
+    } else if(decimals > NUMBER_DECIMALS_MAX) {
+        decimals = NUMBER_DECIMALS_MAX;
+    }
+    
+    scale = powersOfTen[decimals];
+    
+    v = (value < 0) ? -value : value;
+    
+    // also false for NaN
+    if(!(v * scale < 9.0e18)) {
+        return -1;
+    }
+    
+    // the only floating point work: scale and round half away from zero
+    scaled = (uint64_t) (v * scale + 0.5);
+    
+    uint64_t whole = scaled / scale;
+    uint32_t frac  = (uint32_t) (scaled - whole * scale);
+    
+    if(value < 0 && scaled != 0) {
+        *p++ = '-';
+    }
+    
+    p += numberFormatUInt(p, whole);
+    
+    if(frac != 0) {
+        // drop the trailing zeros
+        while(frac % 10 == 0) {
+            frac /= 10;
+            decimals--;
+        }
+        
+        *p++ = '.';
+        
+        for(i = decimals - 1; i >= 0; i--) {
+            p[i] = '0' + (frac % 10);
+            frac /= 10;
+        }
+        
+        p += decimals;
+        *p = '\0';
+    }
+    
+    return p - buf;
+}
+/**
+ * 
+ * @param step
+ * @return 
+ */
+int ICACHE_FLASH_ATTR numberStepDecimals(double step)
+{
+    int decimals;
+    
+    if(step < 0) {
+        step = -step;
+    }
+    
+    if(!(step > 0)) {
+        return NUMBER_DECIMALS_DEFAULT;
+    }
+    
+    for(decimals = 0; decimals < NUMBER_DECIMALS_MAX; decimals++) {
+        double scaled = step * powersOfTen[decimals];
+        double diff   = scaled - (double) (uint64_t) (scaled + 0.5);
+        
+        if(diff < 0) {
+            diff = -diff;
+        }
+        
+        // 0.1 is not exact in binary, allow for the representation error
+        if(diff < scaled * 1.0e-6) {
+            break;
+        }
+    }
+    
+    return decimals;
+}
+
+/******************************************************************************************************************
+ * private functions
+ *
+ */
+
+/**
+ * 
+ * @param end
+ * @param value
+ * @return 
+ */
+char* ICACHE_FLASH_ATTR formatDigits(char* end, uint64_t value)
+{
+    char*    p = end;
+    uint32_t v;
+    
+    // 64 bit division is a library call, get below 2^32 first
+    while(value > 0xffffffffULL) {
+        uint32_t low = (uint32_t) (value % 100000000);
+        int      i;
+        
+        value /= 100000000;
+        
+        for(i = 0; i < 4; i++) {
+            p -= 2;
+            os_memcpy(p, &digitPairs[(low % 100) * 2], 2);
+            low /= 100;
+        }
+    }
+    
+    v = (uint32_t) value;
+    
+    while(v >= 100) {
+        p -= 2;
+        os_memcpy(p, &digitPairs[(v % 100) * 2], 2);
+        v /= 100;
+    }
+    
+    if(v >= 10) {
+        p -= 2;
+        os_memcpy(p, &digitPairs[v * 2], 2);
+    } else {
+        *--p = '0' + v;
+    }
+    
+    return p;
+}
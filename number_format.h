@@ -0,0 +1,89 @@
+/* 
+ * The MIT License (MIT)
+ * 
+ * ESP8266 Non-OS Firmware
+ * Copyright (c) 2015 Michael Jacobsen (github.com/mikejac)
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+
+#ifndef NUMBER_FORMAT_H
+#define	NUMBER_FORMAT_H
+
+#include <github.com/mikejac/misc.esp8266-nonos.cpp/espmissingincludes.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************************************************
+ * 
+ * Integer and fixed-point formatting for the JSON encoders. Doubles are software-emulated on the ESP8266 and 
+ * JEncoder_setDouble()/os_sprintf() write floats with full precision; here a float is scaled once to an integer with
+ * as many decimals as the characteristic's minStep calls for, and integers are written two digits at a time.
+ *
+ */
+
+#define NUMBER_FORMAT_SIZE              24      // "-9223372036854775808" plus zero-termination
+#define NUMBER_DECIMALS_MAX             6
+#define NUMBER_DECIMALS_DEFAULT         NUMBER_DECIMALS_MAX     // floats without a minStep
+
+/******************************************************************************************************************
+ * prototypes
+ *
+ */
+
+/**
+ * 
+ * @param buf at least NUMBER_FORMAT_SIZE bytes
+ * @param value
+ * @return the number of characters written, not counting the zero-termination
+ */
+int numberFormatInt(char* buf, sint64_t value);
+/**
+ * 
+ * @param buf at least NUMBER_FORMAT_SIZE bytes
+ * @param value
+ * @return the number of characters written, not counting the zero-termination
+ */
+int numberFormatUInt(char* buf, uint64_t value);
+/**
+ * Writes 'value' rounded to 'decimals' digits after the decimal point; trailing zeros, and the point itself, are 
+ * left out
+ * @param buf at least NUMBER_FORMAT_SIZE bytes
+ * @param value
+ * @param decimals 0 to NUMBER_DECIMALS_MAX
+ * @return the number of characters written or -1 if 'value' is not finite or too large for fixed-point
+ */
+int numberFormatFixed(char* buf, double value, int decimals);
+/**
+ * 
+ * @param step
+ * @return the number of decimals needed to write multiples of 'step', at most NUMBER_DECIMALS_MAX
+ */
+int numberStepDecimals(double step);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* NUMBER_FORMAT_H */
+
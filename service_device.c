@@ -26,7 +26,7 @@
 
 #include "service_device.h"
 #include "topics.h"
-#include <github.com/mikejac/bluemix.esp8266-nonos.cpp/bluemix.h>
+#include "number_format.h"
 #include <github.com/mikejac/misc.esp8266-nonos.cpp/espmissingincludes.h>
 #include <osapi.h>
 #include <mem.h>
@@ -41,6 +41,12 @@
 
 static STAILQ_HEAD(deviceStailhead, Device_Message) deviceHead = STAILQ_HEAD_INITIALIZER(deviceHead);
 
+// fixed pool of event slots used in coalescing mode; a free slot has format FormatNone
+static Device_Message*  devicePool     = 0;
+static int              devicePoolSize = 0;
+
+#define isPooled(m)     (devicePool != 0 && (m) >= devicePool && (m) < devicePool + devicePoolSize)
+
 /******************************************************************************************************************
  * prototypes
  *
@@ -48,12 +54,207 @@ static STAILQ_HEAD(deviceStailhead, Device_Message) deviceHead = STAILQ_HEAD_INI
 
 /**
  * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ */
+static void deviceDispatch(MqttDevice* d, uint64_t aid, uint64_t iid, CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * 
+ * @param v
+ * @param ptr
+ */
+static void onValuesElement(ValueMessage* v, void* ptr);
+/**
+ * 
+ * @param d
+ * @param actorId
+ * @param msg
+ * @param len
+ * @param subscribe
+ */
+static void deviceSubscription(MqttDevice* d, const char* actorId, char* msg, int len, int subscribe);
+/**
+ * 
+ * @param d
+ * @param mask
+ */
+static void deviceClearSubscribers(MqttDevice* d, uint8_t mask);
+/**
+ * 
+ * @param d
+ * @param mask
+ * @return 1 if any characteristic has a subscriber in 'mask'
+ */
+static int deviceHasSubscribers(MqttDevice* d, uint8_t mask);
+/**
+ * 
+ * @param d
+ * @param nodename
+ * @param since
+ */
+static void deviceResync(MqttDevice* d, const char* nodename, uint32_t since);
+/**
+ * 
+ * @param d
+ * @param nodename
+ * @param serviceId
+ * @param feedId
+ * @param msg
+ * @param retain
+ * @return 
+ */
+static int deviceFeedPublish(MqttDevice* d, const char* nodename, const char* serviceId, const char* feedId, const char* msg, int retain);
+/**
+ * 
+ * @param d
+ * @param a
+ * @return 
+ */
+static int deviceAccessoryPublish(MqttDevice* d, Accessory* a);
+/**
+ * 
+ * @param d
+ * @return 
+ */
+static int deviceIndexPublish(MqttDevice* d);
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param c
+ * @return 
+ */
+static int deviceStatePublish(MqttDevice* d, sint64_t aid, Characteristic* c);
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param c
+ * @param changed
+ * @return 
+ */
+static int deviceStateChanged(MqttDevice* d, sint64_t aid, Characteristic* c, bool changed);
+/**
+ * 
+ * @param d
+ * @param since
+ */
+static void deviceStatesSince(MqttDevice* d, uint32_t since);
+/**
+ * 
+ * @param d
+ * @param actorId
+ * @param msg
+ * @param len
+ */
+static void deviceRead(MqttDevice* d, const char* actorId, char* msg, int len);
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param c
+ * @return 
+ */
+static int deviceBatchAdd(MqttDevice* d, sint64_t aid, Characteristic* c);
+/**
+ * 
+ * @param d
+ * @return 
+ */
+static int deviceBatchFlush(MqttDevice* d);
+/**
+ * 
+ * @param d
+ * @param now
+ */
+static void devicePolicyRun(MqttDevice* d, uint32_t now);
+/**
+ * 
+ * @param d
+ * @return 
+ */
+static uint32_t deviceMillis(MqttDevice* d);
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @param decimals
+ * @return 
+ */
+static int deviceValuePublish(MqttDevice* d, sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int decimals);
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @param decimals
+ * @param feedId
+ * @return 
+ */
+static int deviceValuePublishHeap(MqttDevice* d, sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int decimals, const char* feedId);
+/**
+ * 
+ * @param d
+ * @param feedId
  * @param msg
+ * @param len
+ * @return 
+ */
+static int deviceAddressedValue(MqttDevice* d, const char* feedId, char* msg, int len);
+/**
+ * 
+ * @param buf at least 2 * NUMBER_FORMAT_SIZE bytes
  * @param aid
  * @param iid
+ * @param sep
+ * @return 
+ */
+static int deviceIdsTxt(char* buf, sint64_t aid, sint64_t iid, char sep);
+/**
+ * 
+ * @param d
+ * @param nodename
+ * @param serviceId
+ * @param feedId
+ * @param msg
+ * @param len
+ * @param retain
+ * @return 
+ */
+static int deviceFeedPublishLen(MqttDevice* d, const char* nodename, const char* serviceId, const char* feedId, const char* msg, int len, int retain);
+/**
+ * 
+ * @param d
+ * @param nodename
+ * @return 
+ */
+static int deviceListPublish(MqttDevice* d, const char* nodename);
+/**
+ * 
+ * @param d
+ * @param nodename
+ * @param refs
+ * @param count
+ * @return 
+ */
+static int deviceValuesPublish(MqttDevice* d, const char* nodename, CharacteristicRef* refs, int count);
+/**
+ * 
+ * @param d
+ * @param feedId
+ * @param msg
+ * @param len
  * @return 
  */
-static int unmarshalValue(const char* msg, uint64_t* aid, uint64_t* iid);
+static int deviceCborValue(MqttDevice* d, const char* feedId, char* msg, int len);
 
 /******************************************************************************************************************
  * public functions
@@ -152,6 +353,20 @@ void ICACHE_FLASH_ATTR DeviceDeleteEvent(Device_Message* msg)
         return;
     }
 
+    if(isPooled(msg)) {
+        if(msg->format == FormatNone) {
+            return;
+        }
+        if(msg->format == FormatString && msg->value.String) {
+            os_free(msg->value.String);
+        }
+        
+        STAILQ_REMOVE(&deviceHead, msg, Device_Message, entries);
+
+        msg->format = FormatNone;               // slot is free again
+        return;
+    }
+    
     switch(msg->format) {
         case FormatString:
             if(msg->value.String)   os_free(msg->value.String);
@@ -180,6 +395,68 @@ void ICACHE_FLASH_ATTR DeviceDeleteEvent(Device_Message* msg)
     }
 }
 
+/**
+ * In coalescing mode a new value from a controller overwrites a still pending event for the same aid/iid instead 
+ * of being appended, so the application only ever sees the latest value. Events are taken from a fixed pool of 
+ * 'slots'; with 'slots' <= 0 the pool gets one slot per writable characteristic in the container
+ * @param d
+ * @param slots
+ * @return 
+ */
+int ICACHE_FLASH_ATTR DeviceEnableCoalescing(MqttDevice* d, int slots)
+{
+    if(d == 0) {
+        DTXT("DeviceEnableCoalescing(): 'd' is nil\n");
+        return -1;
+    }
+    
+    if(devicePool != 0) {
+        DTXT("DeviceEnableCoalescing(): already enabled\n");
+        return -1;
+    }
+    
+    if(slots <= 0) {
+        if(d->container == 0) {
+            DTXT("DeviceEnableCoalescing(): no accessories\n");
+            return -1;
+        }
+        
+        slots = 0;
+        
+        for(Accessory* a = d->container->Accessories; a != NULL; a = a->next) {
+            for(Service* s = a->Service; s != NULL; s = s->next) {
+                for(Characteristic* c = s->Characteristics; c != NULL; c = c->next) {
+                    if((c->Perms & PermWrite) == PermWrite) {
+                        slots++;
+                    }
+                }
+            }
+        }
+    }
+    
+    if(slots == 0) {
+        DTXT("DeviceEnableCoalescing(): nothing writable\n");
+        return -1;
+    }
+    
+    devicePool = (Device_Message*) os_zalloc(slots * sizeof(Device_Message));
+    if(devicePool == 0) {
+        DTXT("DeviceEnableCoalescing(Device_Message): mem fail\n");
+        return -1;
+    }
+    
+    for(int i = 0; i < slots; i++) {
+        devicePool[i].format = FormatNone;
+    }
+    
+    devicePoolSize = slots;
+    d->coalesce    = 1;
+    
+    DTXT("DeviceEnableCoalescing(): %d slots\n", slots);
+    
+    return 0;
+}
+
 /******************************************************************************************************************
  * value updates to HomeKit app
  *
@@ -188,97 +465,255 @@ void ICACHE_FLASH_ATTR DeviceDeleteEvent(Device_Message* msg)
 /**
  * 
  * @param d
- * @param aid
- * @param iid
- * @param value
+ * @param window
  * @return 
  */
-int ICACHE_FLASH_ATTR SetValueString(MqttDevice* d, sint64_t aid, sint64_t iid, const char* value)
+int ICACHE_FLASH_ATTR DeviceEnableEchoSuppression(MqttDevice* d, uint32_t window)
 {
-    CharacteristicValue v;
-    v.String = (char*) value;
+    if(d == 0) {
+        DTXT("DeviceEnableEchoSuppression(): 'd' is nil\n");
+        return -1;
+    }
     
-    return setValue(d, aid, iid, FormatString, &v, NULL);
+    d->echoWindow = window;
+    
+    return 0;
 }
 /**
  * 
  * @param d
- * @param aid
- * @param iid
- * @param value
+ * @param enable
  * @return 
  */
-int ICACHE_FLASH_ATTR SetValueBool(MqttDevice* d, sint64_t aid, sint64_t iid, bool value)
+int ICACHE_FLASH_ATTR DeviceEnableSubscriptions(MqttDevice* d, int enable)
 {
-    CharacteristicValue v;
-    v.Bool = value;
+    if(d == 0) {
+        DTXT("DeviceEnableSubscriptions(): 'd' is nil\n");
+        return -1;
+    }
     
-    return setValue(d, aid, iid, FormatBool, &v, NULL);
+    d->subscriptions = enable;
+    
+    return 0;
 }
 /**
  * 
  * @param d
- * @param aid
- * @param iid
- * @param value
+ * @param enable
  * @return 
  */
-int ICACHE_FLASH_ATTR SetValueUInt8(MqttDevice* d, sint64_t aid, sint64_t iid, uint8_t value)
+int ICACHE_FLASH_ATTR DeviceEnableRetainedSchema(MqttDevice* d, int enable)
 {
-    CharacteristicValue v;
-    v.UInt8 = value;
+    if(d == 0) {
+        DTXT("DeviceEnableRetainedSchema(): 'd' is nil\n");
+        return -1;
+    }
     
-    return setValue(d, aid, iid, FormatUInt8, &v, NULL);
+    d->retainedSchema = enable;
+    
+    return 0;
 }
 /**
  * 
  * @param d
- * @param aid
- * @param iid
- * @param value
+ * @param mode
  * @return 
  */
-int ICACHE_FLASH_ATTR SetValueInt8(MqttDevice* d, sint64_t aid, sint64_t iid, int8_t value)
+int ICACHE_FLASH_ATTR DeviceEnableRetainedValues(MqttDevice* d, RetainedValues mode)
 {
-    CharacteristicValue v;
-    v.Int8 = value;
+    if(d == 0) {
+        DTXT("DeviceEnableRetainedValues(): 'd' is nil\n");
+        return -1;
+    }
     
-    return setValue(d, aid, iid, FormatInt8, &v, NULL);
+    d->retainedValues = mode;
+    
+    return 0;
 }
 /**
  * 
  * @param d
- * @param aid
- * @param iid
- * @param value
+ * @param enable
  * @return 
  */
-int ICACHE_FLASH_ATTR SetValueUInt16(MqttDevice* d, sint64_t aid, sint64_t iid, uint16_t value)
+int ICACHE_FLASH_ATTR DeviceEnableAddressedValues(MqttDevice* d, int enable)
 {
-    CharacteristicValue v;
-    v.UInt16 = value;
+    if(d == 0) {
+        DTXT("DeviceEnableAddressedValues(): 'd' is nil\n");
+        return -1;
+    }
     
-    return setValue(d, aid, iid, FormatUInt16, &v, NULL);
+    d->addressedValues = enable;
+    
+    return 0;
 }
 /**
  * 
  * @param d
- * @param aid
- * @param iid
- * @param value
+ * @param enable
  * @return 
  */
-int ICACHE_FLASH_ATTR SetValueInt16(MqttDevice* d, sint64_t aid, sint64_t iid, int16_t value)
+int ICACHE_FLASH_ATTR DeviceEnableCbor(MqttDevice* d, int enable)
 {
-    CharacteristicValue v;
-    v.Int16 = value;
+    if(d == 0) {
+        DTXT("DeviceEnableCbor(): 'd' is nil\n");
+        return -1;
+    }
     
-    return setValue(d, aid, iid, FormatInt16, &v, NULL);
+    d->cbor = enable;
+    
+    return 0;
 }
 /**
  * 
  * @param d
- * @param aid
+ * @param enable
+ * @return 
+ */
+int ICACHE_FLASH_ATTR DeviceEnableCompactList(MqttDevice* d, int enable)
+{
+    if(d == 0) {
+        DTXT("DeviceEnableCompactList(): 'd' is nil\n");
+        return -1;
+    }
+    
+    d->compactList = enable;
+    
+    return 0;
+}
+/**
+ * 
+ * @param d
+ * @param aid
+ * @return 
+ */
+int ICACHE_FLASH_ATTR PublishAccessory(MqttDevice* d, sint64_t aid)
+{
+    if(d == 0 || d->container == 0) {
+        DTXT("PublishAccessory(): 'd' is nil or has no accessories\n");
+        return -1;
+    }
+    
+    if(!d->retainedSchema) {
+        devicePublish(d);
+        return 0;
+    }
+    
+    Accessory* a = FindByAid(d->container, aid);
+    
+    if(a != 0) {
+        if(deviceAccessoryPublish(d, a) != 0) {
+            return -1;
+        }
+    } else {
+        char feedId[NUMBER_FORMAT_SIZE];
+        
+        // removed, or it got another aid; an empty retained message deletes the stale document at the broker
+        DTXT("PublishAccessory(): aid = %d is gone; clearing its document\n", (int) aid);
+        
+        numberFormatInt(feedId, aid);
+        
+        if(deviceFeedPublishLen(d, fabricNodenameBroadcast, fabricServiceIdAccessories, feedId, "", 0, 1) != 0) {
+            return -1;
+        }
+    }
+    
+    return deviceIndexPublish(d);
+}
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR SetValueString(MqttDevice* d, sint64_t aid, sint64_t iid, const char* value)
+{
+    CharacteristicValue v;
+    v.String = (char*) value;
+    
+    return setValue(d, aid, iid, FormatString, &v, NULL);
+}
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR SetValueBool(MqttDevice* d, sint64_t aid, sint64_t iid, bool value)
+{
+    CharacteristicValue v;
+    v.Bool = value;
+    
+    return setValue(d, aid, iid, FormatBool, &v, NULL);
+}
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR SetValueUInt8(MqttDevice* d, sint64_t aid, sint64_t iid, uint8_t value)
+{
+    CharacteristicValue v;
+    v.UInt8 = value;
+    
+    return setValue(d, aid, iid, FormatUInt8, &v, NULL);
+}
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR SetValueInt8(MqttDevice* d, sint64_t aid, sint64_t iid, int8_t value)
+{
+    CharacteristicValue v;
+    v.Int8 = value;
+    
+    return setValue(d, aid, iid, FormatInt8, &v, NULL);
+}
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR SetValueUInt16(MqttDevice* d, sint64_t aid, sint64_t iid, uint16_t value)
+{
+    CharacteristicValue v;
+    v.UInt16 = value;
+    
+    return setValue(d, aid, iid, FormatUInt16, &v, NULL);
+}
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param iid
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR SetValueInt16(MqttDevice* d, sint64_t aid, sint64_t iid, int16_t value)
+{
+    CharacteristicValue v;
+    v.Int16 = value;
+    
+    return setValue(d, aid, iid, FormatInt16, &v, NULL);
+}
+/**
+ * 
+ * @param d
+ * @param aid
  * @param iid
  * @param value
  * @return 
@@ -361,93 +796,106 @@ int ICACHE_FLASH_ATTR setValue(MqttDevice* d, sint64_t aid, sint64_t iid, Charac
         }
     }
     
+    if(characteristicFormatTxt(format) == 0) {
+        DTXT("setValue(): invalid format\n");
+        return -1;
+    }
+    
+    uint32_t now = deviceMillis(d);
+    
+    // the retained state follows every change; the filters below only concern the to_hk feed
+    bool changed = !characteristicValueIs(c, format, value);
+    
+    if(d->subscriptions && c->subscribers == 0) {
+        characteristicSetValue(c, format, value);   // nobody is listening
+        return deviceStateChanged(d, aid, c, changed);
+    }
+    
+    if(d->echoWindow > 0 && characteristicIsEcho(c, format, value, now, d->echoWindow)) {
+        DTXT("setValue(): echo of a controller write; not published\n");
+        
+        characteristicSetValue(c, format, value);
+        characteristicPolicyPublished(c, now);      // the controller already has it
+        
+        return deviceStateChanged(d, aid, c, changed);
+    }
+    
+    PolicyVerdict verdict = characteristicPolicyCheck(c, format, value, now);
+    
     // update the value
     characteristicSetValue(c, format, value);
     
-    char* msg = MarshalValue(aid, iid, format, value);
-    if(msg == 0) {
-        DTXT("setValue(MarshalValue): failed\n");
+    deviceStateChanged(d, aid, c, changed);
+    
+    if(d->retainedValues == RetainedValuesOnly) {
+        return 0;
+    }
+    
+    if(verdict != PolicyPublish) {
+        return 0;           // held back or filtered by the publish policy
+    }
+    
+    characteristicPolicyPublished(c, now);
+    
+    if(d->batching > 0 || d->autoFlush) {
+        return deviceBatchAdd(d, aid, c);
+    }
+    
+    return deviceValuePublish(d, aid, iid, format, value, characteristicDecimals(c));
+}
+/**
+ * 
+ * @param d
+ * @return 
+ */
+int ICACHE_FLASH_ATTR DeviceBatchBegin(MqttDevice* d)
+{
+    if(d == 0) {
+        DTXT("DeviceBatchBegin(): 'd' is nil\n");
         return -1;
     }
     
-    DTXT("setValue(): msg = '%s'\n", msg);
-
-    const char* formatTxt = NULL;
+    d->batching++;
     
-    switch(format) {
-        case FormatString:
-            formatTxt = FormatStringTxt;
-            break;
-
-        case FormatBool:
-            formatTxt = FormatBoolTxt;
-            break;
-            
-        case FormatUInt8:
-            formatTxt = FormatUInt8Txt;
-            break;
-            
-        case FormatInt8:
-            formatTxt = FormatInt8Txt;
-            break;
-            
-        case FormatUInt16:
-            formatTxt = FormatUInt16Txt;
-            break;
-            
-        case FormatInt16:
-            formatTxt = FormatInt16Txt;
-            break;
-            
-        case FormatUInt32:
-            formatTxt = FormatUInt32Txt;
-            break;
-            
-        case FormatInt32:
-            formatTxt = FormatInt32Txt;
-            break;
-            
-        case FormatUInt64:
-            formatTxt = FormatUInt64Txt;
-            break;
-            
-        case FormatFloat:   
-            formatTxt = FormatFloatTxt;
-            break;
-            
-        case FormatNone:
-            break;
+    return 0;
+}
+/**
+ * 
+ * @param d
+ * @return 
+ */
+int ICACHE_FLASH_ATTR DeviceBatchCommit(MqttDevice* d)
+{
+    if(d == 0) {
+        DTXT("DeviceBatchCommit(): 'd' is nil\n");
+        return -1;
     }
     
-    char* topic = (char*) os_malloc(topicOfframpPublish(d->parent, 
-                                                        fabricNodenameBroadcast,		// destination nodename 
-                                                        fabricTaskIdService, 			// taskId 
-                                                        GetPlatformId(d->parent),		// platformId
-                                                        fabricServiceIdToHK,                    // serviceId 
-                                                        formatTxt,
-                                                        0));
+    if(d->batching > 0 && --d->batching > 0) {
+        return 0;           // an outer batch is still open
+    }
     
-    if(topic == 0) {
-        DTXT("setValue(topic): mem fail\n");
-        os_free(msg);
+    return deviceBatchFlush(d);
+}
+/**
+ * 
+ * @param d
+ * @param enable
+ * @return 
+ */
+int ICACHE_FLASH_ATTR DeviceEnableAutoFlush(MqttDevice* d, int enable)
+{
+    if(d == 0) {
+        DTXT("DeviceEnableAutoFlush(): 'd' is nil\n");
         return -1;
     }
     
-    topicOfframpPublish(d->parent, 
-                        fabricNodenameBroadcast,		// destination nodename 
-                        fabricTaskIdService, 			// taskId 
-                        GetPlatformId(d->parent),		// platformId
-                        fabricServiceIdToHK,                    // serviceId 
-                        formatTxt,
-                        topic);
-
-    DTXT("setValue(): topic = '%s'\n", topic);
-
-    MQTT_Publish(&d->parent->client, topic, msg, os_strlen(msg), d->qos, 0);
-
-    os_free(topic);
-    os_free(msg);
-
+    d->autoFlush = enable;
+    
+    if(!enable && d->batching == 0) {
+        return deviceBatchFlush(d);
+    }
+    
     return 0;
 }
 /**
@@ -456,40 +904,39 @@ int ICACHE_FLASH_ATTR setValue(MqttDevice* d, sint64_t aid, sint64_t iid, Charac
  */
 void ICACHE_FLASH_ATTR devicePublish(MqttDevice* d)
 {
-    char* topic = (char*) os_malloc(topicOfframpPublish(d->parent, 
-                                                        fabricNodenameBroadcast,		// destination nodename 
-                                                        fabricTaskIdService, 			// taskId 
-                                                        GetPlatformId(d->parent),		// platformId
-                                                        fabricServiceIdAccessories,		// serviceId 
-                                                        "list",
-                                                        0));
-    
-    if(topic == 0) {
-        DTXT("devicePublish(topic): mem fail\n");
+    if(d->retainedSchema) {
+        for(Accessory* a = d->container->Accessories; a != 0; a = a->next) {
+            deviceAccessoryPublish(d, a);
+        }
+        
+        if(deviceIndexPublish(d) == 0) {
+            d->listPublished = 1;
+        }
+        
         return;
     }
     
-    topicOfframpPublish(d->parent, 
-                        fabricNodenameBroadcast,		// destination nodename 
-                        fabricTaskIdService, 			// taskId 
-                        GetPlatformId(d->parent),		// platformId
-                        fabricServiceIdAccessories,		// serviceId 
-                        "list",
-                        topic);
-
-    DTXT("devicePublish(): topic = '%s'\n", topic);
-
-    char* msg = marshalContainer(d->container);
-    if(msg == 0) {
-        DTXT("devicePublish(): marshal fail\n");
-    } else {
-        DTXT("devicePublish(): len = %d\n", os_strlen(msg));
-        DTXT("devicePublish(): %s\n", msg);
-        MQTT_Publish(&d->parent->client, topic, msg, os_strlen(msg), d->qos, 0);
-        os_free(msg);
+    if(deviceListPublish(d, NodenameControllers) == 0) {
+        d->listPublished = 1;
+    }
+}
+/**
+ * 
+ * @param d
+ */
+void ICACHE_FLASH_ATTR deviceRun(MqttDevice* d)
+{
+    uint32_t now = deviceMillis(d);
+    
+    if(now - d->policyTick >= DEVICE_POLICY_TICK) {
+        d->policyTick = now;
+        
+        devicePolicyRun(d, now);
+    }
+    
+    if(d->autoFlush && d->batching == 0 && d->batchCount > 0) {
+        deviceBatchFlush(d);
     }
-
-    os_free(topic);
 }
 /**
  * 
@@ -498,13 +945,13 @@ void ICACHE_FLASH_ATTR devicePublish(MqttDevice* d)
 void ICACHE_FLASH_ATTR deviceSubscribe(MqttDevice* d)
 {
     char* topic = (char*) os_malloc(topicOfframpSubscribe(  d->parent, 
-                                                            GetNodename(d->parent), 
+                                                            topicNodename(d->parent), 
                                                             fabricTopicAny,             // actorID == senders nodename
                                                             fabricTopicAny,             // actorPlatformID == senders platformId
                                                             fabricTaskIdService,        // taskId 
                                                             fabricTopicAny,             // platformId == aid
                                                             fabricServiceIdFromHK,      // serviceId
-                                                            fabricTopicAny,             // feedId
+                                                            fabricTopicAll,             // feedId; addressed values have three levels
                                                             0));
     
     if(topic == 0) {
@@ -513,13 +960,13 @@ void ICACHE_FLASH_ATTR deviceSubscribe(MqttDevice* d)
     }
     
     topicOfframpSubscribe(  d->parent, 
-                            GetNodename(d->parent), 
+                            topicNodename(d->parent), 
                             fabricTopicAny,             // actorID == senders nodename
                             fabricTopicAny,             // actorPlatformID == senders platformId
                             fabricTaskIdService,        // taskId 
                             fabricTopicAny,             // platformId 
                             fabricServiceIdFromHK,      // serviceId
-                            fabricTopicAny,             // feedId
+                            fabricTopicAll,             // feedId; addressed values have three levels
                             topic);
     
     MQTT_Subscribe(&d->parent->client, topic, d->qos);
@@ -540,120 +987,993 @@ void ICACHE_FLASH_ATTR deviceSubscribe(MqttDevice* d)
  * @param actorId
  * @param feedId
  * @param msg
+ * @param len
  */
-void ICACHE_FLASH_ATTR onValueUpdate(MqttDevice* d, const char* actorId, const char* feedId, const char* msg)
+void ICACHE_FLASH_ATTR onValueUpdate(MqttDevice* d, const char* actorId, const char* feedId, char* msg, int len)
 {
-    uint64_t aid;
-    uint64_t iid;
+    ValueMessage v;
     
-    if(unmarshalValue(msg, &aid, &iid) == 0) {
-        if(os_strcmp(feedId, FormatStringTxt) == 0) {
-
-        } else if(os_strcmp(feedId, FormatBoolTxt) == 0) {
-            bool value;
-
-            if(BMix_GetBool("value", &value) == 0) {
-                DTXT("onValueUpdate(): bool; value = %s\n", (value == true) ? "True" : "False");
-
-                // append to queue
-                Device_Message* msg = os_malloc(sizeof(Device_Message));
-                if(msg != 0) {
-                    msg->aid        = aid;
-                    msg->iid        = iid;
-                    msg->acc        = FindByAid(d->container, aid);
-                    msg->format     = FormatBool;
-                    msg->value.Bool = value;
-
-                    STAILQ_INSERT_TAIL(&deviceHead, msg, entries);                                // insert at end
-                }
-            }
-        } else if(os_strcmp(feedId, FormatFloatTxt) == 0) {
-            double value;
-
-            if(BMix_GetDouble("value", &value) == 0) {
-                DTXT("onValueUpdate(): float");
-                
-                // append to queue
-                Device_Message* msg = os_malloc(sizeof(Device_Message));
-                if(msg != 0) {
-                    msg->aid         = aid;
-                    msg->iid         = iid;
-                    msg->acc         = FindByAid(d->container, aid);
-                    msg->format      = FormatFloat;
-                    msg->value.Float = value;
-
-                    STAILQ_INSERT_TAIL(&deviceHead, msg, entries);                                // insert at end
-                }
-            }
-        } else if(os_strcmp(feedId, FormatUInt8Txt) == 0) {
-            int value;
-
-            if(BMix_GetInt("value", &value) == 0) {
-                DTXT("onValueUpdate(): uint8; value = %d\n", value);
-
-                // append to queue
-                Device_Message* msg = os_malloc(sizeof(Device_Message));
-                if(msg != 0) {
-                    msg->aid         = aid;
-                    msg->iid         = iid;
-                    msg->acc         = FindByAid(d->container, aid);
-                    msg->format      = FormatUInt8;
-                    msg->value.UInt8 = (uint8_t)value;
-
-                    STAILQ_INSERT_TAIL(&deviceHead, msg, entries);                                // insert at end
-                }
-            }
-        } else if(os_strcmp(feedId, FormatUInt16Txt) == 0) {
-
-        } else if(os_strcmp(feedId, FormatUInt32Txt) == 0) {
-
-        } else if(os_strcmp(feedId, FormatInt32Txt) == 0) {
-
-        } else if(os_strcmp(feedId, FormatUInt64Txt) == 0) {
-
-        } else if(os_strcmp(feedId, FormatDataTxt) == 0) {
-            DTXT("onValueUpdate(): unhandled format; '%s'\n", feedId);
-        } else if(os_strcmp(feedId, FormatTLV8Txt) == 0) {
-            DTXT("onValueUpdate(): unhandled format; '%s'\n", feedId);
-        } else if(os_strcmp(feedId, FormatInt8Txt) == 0) {
-
-        } else if(os_strcmp(feedId, FormatInt16Txt) == 0) {
-
+    if(os_strcmp(feedId, "read") == 0) {
+        deviceRead(d, actorId, msg, len);
+        return;
+    }
+    
+    if(os_strcmp(feedId, "resync") == 0) {
+        uint32_t since;
+        
+        if(UnmarshalSeq(msg, len, &since) == 0) {
+            deviceResync(d, actorId, since);
+        }
+        return;
+    }
+    
+    if(os_strcmp(feedId, "subscribe") == 0 || os_strcmp(feedId, "unsubscribe") == 0) {
+        deviceSubscription(d, actorId, msg, len, feedId[0] == 's');
+        return;
+    }
+    
+    if(os_strcmp(feedId, "values") == 0) {
+        // several values in one message; each is dispatched as it is decoded
+        int count = UnmarshalValues(d->container, msg, len, onValuesElement, d);
+        
+        DTXT("onValueUpdate(): %d values\n", count);
+        return;
+    }
+    
+    if(os_strstr(feedId, "/") != 0) {
+        deviceAddressedValue(d, feedId, msg, len);
+        return;
+    }
+    
+    if(os_strstr(feedId, FeedIdCborSuffix) != 0) {
+        deviceCborValue(d, feedId, msg, len);
+        return;
+    }
+    
+    if(UnmarshalValue(msg, len, feedId, &v) != 0) {
+        DTXT("onValueUpdate(): unhandled message; feedId = '%s'\n", feedId);
+        return;
+    }
+    
+    DTXT("onValueUpdate(): aid = %d, iid = %d, format = %d\n", (int) v.Aid, (int) v.Iid, v.Format);
+    
+    deviceDispatch(d, v.Aid, v.Iid, v.Format, &v.Value);
+}
+/**
+ * Answers a "read" request with the current values of the requested characteristics, sent to the requester only
+ * @param d
+ * @param actorId   the requesters nodename
+ * @param msg
+ * @param len
+ */
+void ICACHE_FLASH_ATTR deviceRead(MqttDevice* d, const char* actorId, char* msg, int len)
+{
+    CharacteristicRef refs[DEVICE_READ_SIZE];
+    
+    int count = UnmarshalIds(d->container, msg, len, refs, DEVICE_READ_SIZE);
+    if(count <= 0) {
+        DTXT("deviceRead(): nothing to read\n");
+        return;
+    }
+    
+    int      readable = 0;
+    uint32_t since    = d->container->seq;
+    
+    // write-only characteristics have no value to hand out
+    for(int i = 0; i < count; i++) {
+        if((refs[i].C->Perms & PermRead) == 0) {
+            DTXT("deviceRead(): aid = %d, iid = %d is not readable\n", (int) refs[i].Aid, (int) refs[i].C->ID);
+            continue;
+        }
+        
+        characteristicRefresh(refs[i].C);
+        
+        refs[readable++] = refs[i];
+    }
+    
+    // the getters may have changed values
+    deviceStatesSince(d, since);
+    
+    if(readable == 0) {
+        return;
+    }
+    
+    deviceValuesPublish(d, actorId, refs, readable);
+}
+/**
+ * 
+ * @param d
+ */
+void ICACHE_FLASH_ATTR deviceConnected(MqttDevice* d)
+{
+    deviceSubscribe(d);
+    
+    if(!d->listPublished) {
+        devicePublish(d);
+    } else if(d->container != 0 && d->container->seq != d->disconnectSeq) {
+        deviceResync(d, NodenameControllers, d->disconnectSeq);
+    }
+}
+/**
+ * 
+ * @param d
+ */
+void ICACHE_FLASH_ATTR deviceDisconnected(MqttDevice* d)
+{
+    if(d->container != 0) {
+        d->disconnectSeq = d->container->seq;
+    }
+}
+/**
+ * 
+ * @param d
+ * @param nodename
+ * @param online
+ */
+void ICACHE_FLASH_ATTR deviceControllerStatus(MqttDevice* d, const char* nodename, int online)
+{
+    int i;
+    
+    if(nodename == 0) {
+        return;
+    }
+    
+    // whether it went away or (re)started, the controller holds no subscriptions anymore
+    for(i = 0; i < DEVICE_CONTROLLERS; i++) {
+        if(d->controllers[i] != 0 && os_strcmp(d->controllers[i], nodename) == 0) {
+            DTXT("deviceControllerStatus(): '%s' %s; subscriptions dropped\n", nodename, online ? "restarted" : "offline");
+            
+            deviceClearSubscribers(d, 1 << i);
+            
+            os_free(d->controllers[i]);
+            d->controllers[i] = 0;
+            break;
+        }
+    }
+    
+    // with retained schema the controller gets the accessories from the broker
+    if(online && !d->retainedSchema) {
+        devicePublish(d);
+    }
+}
+/**
+ * 
+ * @param d
+ * @param actorId   the controllers nodename
+ * @param msg
+ * @param len
+ * @param subscribe
+ */
+void ICACHE_FLASH_ATTR deviceSubscription(MqttDevice* d, const char* actorId, char* msg, int len, int subscribe)
+{
+    CharacteristicRef refs[DEVICE_READ_SIZE];
+    int               slot = -1;
+    int               i;
+    
+    // find the controllers slot or take a free one
+    for(i = 0; i < DEVICE_CONTROLLERS; i++) {
+        if(d->controllers[i] != 0 && os_strcmp(d->controllers[i], actorId) == 0) {
+            slot = i;
+            break;
+        } else if(d->controllers[i] == 0 && slot < 0) {
+            slot = i;
+        }
+    }
+    
+    if(slot < 0) {
+        DTXT("deviceSubscription(): no free controller slot for '%s'\n", actorId);
+        return;
+    }
+    
+    int count = UnmarshalIds(d->container, msg, len, refs, DEVICE_READ_SIZE);
+    if(count <= 0) {
+        DTXT("deviceSubscription(): no ids\n");
+        return;
+    }
+    
+    if(d->controllers[slot] == 0) {
+        if(!subscribe) {
+            return;             // not subscribed to anything
+        }
+        
+        d->controllers[slot] = (char*) os_malloc(os_strlen(actorId) + 1);
+        if(d->controllers[slot] == 0) {
+            DTXT("deviceSubscription(): mem fail\n");
+            return;
+        }
+        
+        os_strcpy(d->controllers[slot], actorId);
+    }
+    
+    for(i = 0; i < count; i++) {
+        Characteristic* c = refs[i].C;
+        
+        if((c->Perms & PermEvents) == 0) {
+            DTXT("deviceSubscription(): aid = %d, iid = %d has no events\n", (int) refs[i].Aid, (int) c->ID);
+        } else if(subscribe) {
+            c->subscribers |= (1 << slot);
         } else {
-            DTXT("onValueUpdate(): unknown format; '%s'\n", feedId);
+            c->subscribers &= ~(1 << slot);
         }
     }
+    
+    // a controller subscribed to nothing gives its slot back
+    if(!deviceHasSubscribers(d, 1 << slot)) {
+        DTXT("deviceSubscription(): '%s' has no subscriptions left\n", actorId);
+        
+        os_free(d->controllers[slot]);
+        d->controllers[slot] = 0;
+    }
 }
 /**
  * 
+ * @param v
+ * @param ptr
+ */
+void ICACHE_FLASH_ATTR onValuesElement(ValueMessage* v, void* ptr)
+{
+    deviceDispatch((MqttDevice*) ptr, v->Aid, v->Iid, v->Format, &v->Value);
+}
+/**
+ * Hands a value written by a controller to the application; either directly through a write callback or by 
+ * queueing it for DeviceGetEvent(). Writes to unknown or read-only characteristics, or in the wrong format, are dropped
+ * @param d
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ */
+void ICACHE_FLASH_ATTR deviceDispatch(MqttDevice* d, uint64_t aid, uint64_t iid, CharacteristicFormat format, CharacteristicValue* value)
+{
+    Accessory*      a = FindByAid(d->container, aid);
+    Characteristic* c = FindCharacteristicByIid(a, iid);
+    
+    if(c == 0) {
+        DTXT("deviceDispatch(): aid = %d, iid = %d not found\n", (int) aid, (int) iid);
+        return;
+    }
+    
+    if(c->Format != format || (c->Perms & PermWrite) == 0) {
+        DTXT("deviceDispatch(): aid = %d, iid = %d not writable with this format\n", (int) aid, (int) iid);
+        return;
+    }
+    
+    // only a write that is going to be applied can come back as an echo
+    if(d->echoWindow > 0) {
+        characteristicNoteWrite(c, format, value, deviceMillis(d));
+    }
+    
+    if(c->onWrite != 0 || a->onWrite != 0) {
+        bool changed = !characteristicValueIs(c, format, value);
+        
+        // apply the value and let the application act on it right away
+        characteristicSetValue(c, format, value);
+        deviceStateChanged(d, aid, c, changed);
+        
+        if(c->onWrite != 0) {
+            c->onWrite(a, c, c->Value, c->onWritePtr);
+        } else {
+            a->onWrite(a, c, c->Value, a->onWritePtr);
+        }
+        
+        return;
+    }
+    
+    Device_Message*     msg;
+    Device_Message*     pending = 0;
+    CharacteristicValue v       = *value;
+    
+    if(d->coalesce) {
+        // a pending event for the same characteristic is overwritten in place
+        STAILQ_FOREACH(pending, &deviceHead, entries) {
+            if(pending->aid == aid && pending->iid == iid) {
+                break;
+            }
+        }
+        
+        msg = pending;
+        
+        // otherwise take a free slot
+        for(int i = 0; msg == 0 && i < devicePoolSize; i++) {
+            if(devicePool[i].format == FormatNone) {
+                msg = &devicePool[i];
+            }
+        }
+        
+        if(msg == 0) {
+            DTXT("deviceDispatch(): no free slot; aid = %d, iid = %d dropped\n", (int) aid, (int) iid);
+            return;
+        }
+    } else {
+        msg = os_malloc(sizeof(Device_Message));
+        if(msg == 0) {
+            DTXT("deviceDispatch(Device_Message): mem fail\n");
+            return;
+        }
+    }
+    
+    // the event owns a copy of string values
+    if(format == FormatString) {
+        v.String = (char*) os_malloc(os_strlen(value->String) + 1);
+        if(v.String == 0) {
+            DTXT("deviceDispatch(String): mem fail\n");
+            
+            if(!d->coalesce) {
+                os_free(msg);
+            }
+            return;                 // a pool slot stays free, a pending event keeps its value
+        }
+        
+        os_strcpy(v.String, value->String);
+    }
+    
+    if(pending != 0) {
+        if(pending->format == FormatString && pending->value.String) {
+            os_free(pending->value.String);
+        }
+        
+        pending->format = format;
+        pending->value  = v;
+        
+        return;
+    }
+    
+    msg->aid    = aid;
+    msg->iid    = iid;
+    msg->acc    = a;
+    msg->format = format;
+    msg->value  = v;
+
+    STAILQ_INSERT_TAIL(&deviceHead, msg, entries);                                // insert at end
+}
+/**
+ * Publishes a message on one of our service feeds
+ * @param d
+ * @param nodename  destination nodename, fabricNodenameBroadcast or NodenameControllers
+ * @param serviceId
+ * @param feedId
  * @param msg
+ * @param retain
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceFeedPublish(MqttDevice* d, const char* nodename, const char* serviceId, const char* feedId, const char* msg, int retain)
+{
+    return OfframpPublish(d->parent, nodename, fabricTaskIdService, serviceId, feedId, msg, os_strlen(msg), d->qos, retain);
+}
+/**
+ * deviceFeedPublish() for binary messages
+ * @param d
+ * @param nodename
+ * @param serviceId
+ * @param feedId
+ * @param msg
+ * @param len
+ * @param retain
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceFeedPublishLen(MqttDevice* d, const char* nodename, const char* serviceId, const char* feedId, const char* msg, int len, int retain)
+{
+    return OfframpPublish(d->parent, nodename, fabricTaskIdService, serviceId, feedId, msg, len, d->qos, retain);
+}
+/**
+ * 
+ * @param d
+ * @param aid
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceBatchAdd(MqttDevice* d, sint64_t aid, Characteristic* c)
+{
+    int i;
+    
+    // the value lives in the characteristic, so a second update needs no new entry
+    for(i = 0; i < d->batchCount; i++) {
+        if(d->batch[i].C == c) {
+            return 0;
+        }
+    }
+    
+    if(d->batchCount == DEVICE_BATCH_SIZE) {
+        DTXT("deviceBatchAdd(): batch full; committing\n");
+        deviceBatchFlush(d);
+    }
+    
+    d->batch[d->batchCount].Aid = aid;
+    d->batch[d->batchCount].C   = c;
+    d->batchCount++;
+    
+    return 0;
+}
+/**
+ * A single entry goes out as an ordinary value message on its format feed, more than one as a "values" message - 
+ * unless values are addressed
+ * @param d
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceBatchFlush(MqttDevice* d)
+{
+    int ret;
+    
+    if(d->batchCount == 0) {
+        return 0;
+    }
+    
+    // the retained states went out as the values changed, see deviceStateChanged()
+    if(d->retainedValues == RetainedValuesOnly) {
+        d->batchCount = 0;
+        return 0;
+    }
+    
+    if(d->batchCount == 1 || d->addressedValues) {
+        // addressed values can only be filtered by the broker one by one
+        ret = 0;
+        
+        for(int i = 0; i < d->batchCount; i++) {
+            Characteristic* c = d->batch[i].C;
+            
+            if(deviceValuePublish(d, d->batch[i].Aid, c->ID, c->Format, c->Value, characteristicDecimals(c)) != 0) {
+                ret = -1;
+            }
+        }
+        
+        d->batchCount = 0;
+        
+        return ret;
+    }
+    
+    ret = deviceValuesPublish(d, NodenameControllers, d->batch, d->batchCount);
+    
+    d->batchCount = 0;
+    
+    return ret;
+}
+/**
+ * Publishes held back values, heartbeats and sampled values that are due, all in one batch
+ * @param d
+ * @param now
+ */
+void ICACHE_FLASH_ATTR devicePolicyRun(MqttDevice* d, uint32_t now)
+{
+    if(d->container == 0) {
+        return;
+    }
+    
+    DeviceBatchBegin(d);
+    
+    Accessory* a = d->container->Accessories;
+    
+    while(a != 0) {
+        Service* s = a->Service;
+        
+        while(s != 0) {
+            Characteristic* c = s->Characteristics;
+            
+            while(c != 0) {
+                int            due    = characteristicPolicyDue(c, now);
+                int            wanted = !d->subscriptions || c->subscribers != 0;
+                PublishPolicy* p      = c->policy;
+                
+                // a characteristic with a getter is sampled when somebody wants it (a controller or the retained state)
+                // and its policy would allow a publish; without an interval or a deadband only for the heartbeat
+                if((wanted || d->retainedValues != RetainedValuesOff) && c->onRead != 0 && p != 0 && 
+                   (due || ((p->minInterval > 0 || p->deadband > 0 || p->deadbandRel > 0) && 
+                            (!p->published || now - p->lastPublished >= p->minInterval)))) {
+                    CharacteristicValue v;
+                    
+                    if(c->onRead(c, &v, c->onReadPtr) == 0) {
+                        bool changed = !characteristicValueIs(c, c->Format, &v);
+                        
+                        if(characteristicPolicyCheck(c, c->Format, &v, now) == PolicyPublish) {
+                            due = 1;
+                        }
+                        
+                        characteristicSetValue(c, c->Format, &v);
+                        deviceStateChanged(d, a->ID, c, changed);
+                    }
+                }
+                
+                if(due && wanted) {
+                    characteristicPolicyPublished(c, now);
+                    deviceBatchAdd(d, a->ID, c);
+                }
+                
+                c = c->next;
+            }
+            
+            s = s->next;
+        }
+        
+        a = a->next;
+    }
+    
+    DeviceBatchCommit(d);
+}
+/**
+ * system_get_time() wraps after ~71 minutes; this clock wraps after ~49 days and is safe to compare by subtraction
+ * @param d
+ * @return 
+ */
+uint32_t ICACHE_FLASH_ATTR deviceMillis(MqttDevice* d)
+{
+    uint32_t ms = (system_get_time() - d->clockUs) / 1000;
+    
+    d->clockUs += ms * 1000;
+    d->clockMs += ms;
+    
+    return d->clockMs;
+}
+/**
+ * 
+ * @param d
+ * @param mask
+ */
+void ICACHE_FLASH_ATTR deviceClearSubscribers(MqttDevice* d, uint8_t mask)
+{
+    if(d->container == 0) {
+        return;
+    }
+    
+    Accessory* a = d->container->Accessories;
+    
+    while(a != 0) {
+        Service* s = a->Service;
+        
+        while(s != 0) {
+            Characteristic* c = s->Characteristics;
+            
+            while(c != 0) {
+                c->subscribers &= ~mask;
+                c = c->next;
+            }
+            
+            s = s->next;
+        }
+        
+        a = a->next;
+    }
+}
+/**
+ * 
+ * @param d
+ * @param mask
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceHasSubscribers(MqttDevice* d, uint8_t mask)
+{
+    if(d->container == 0) {
+        return 0;
+    }
+    
+    for(Accessory* a = d->container->Accessories; a != 0; a = a->next) {
+        for(Service* s = a->Service; s != 0; s = s->next) {
+            for(Characteristic* c = s->Characteristics; c != 0; c = c->next) {
+                if(c->subscribers & mask) {
+                    return 1;
+                }
+            }
+        }
+    }
+    
+    return 0;
+}
+/**
+ * Sends the changes after 'since' as a "values" message - or the full accessory list when the journal has wrapped
+ * @param d
+ * @param nodename  destination nodename, fabricNodenameBroadcast or NodenameControllers
+ * @param since
+ */
+void ICACHE_FLASH_ATTR deviceResync(MqttDevice* d, const char* nodename, uint32_t since)
+{
+    CharacteristicRef refs[CONTAINER_JOURNAL_SIZE];
+    
+    int count = ContainerChanges(d->container, since, refs);
+    
+    DTXT("deviceResync(): since = %u, seq = %u, count = %d\n", since, d->container->seq, count);
+    
+    if(count < 0) {
+        deviceListPublish(d, nodename);
+    } else {
+        // even without changes the reply tells the controller the current seq
+        deviceValuesPublish(d, nodename, refs, count);
+    }
+}
+/**
+ * 
+ * @param d
+ * @param a
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceAccessoryPublish(MqttDevice* d, Accessory* a)
+{
+    char     feedId[NUMBER_FORMAT_SIZE];
+    uint32_t since = d->container->seq;
+    
+    // marshalling samples the getters
+    char* msg = MarshalAccessory(d->container, a);
+    
+    deviceStatesSince(d, since);
+    
+    if(msg == 0) {
+        DTXT("deviceAccessoryPublish(): marshal fail\n");
+        return -1;
+    }
+    
+    numberFormatInt(feedId, a->ID);
+    
+    int ret = deviceFeedPublish(d, fabricNodenameBroadcast, fabricServiceIdAccessories, feedId, msg, 1);
+    
+    os_free(msg);
+    
+    return ret;
+}
+/**
+ * 
+ * @param d
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceIndexPublish(MqttDevice* d)
+{
+    char* msg = MarshalIndex(d->container);
+    if(msg == 0) {
+        DTXT("deviceIndexPublish(): marshal fail\n");
+        return -1;
+    }
+    
+    int ret = deviceFeedPublish(d, fabricNodenameBroadcast, fabricServiceIdAccessories, "index", msg, 1);
+    
+    os_free(msg);
+    
+    return ret;
+}
+/**
+ * Publishes the current value of 'c' retained on its state topic
+ * @param d
+ * @param aid
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceStatePublish(MqttDevice* d, sint64_t aid, Characteristic* c)
+{
+    char       feedId[2 * NUMBER_FORMAT_SIZE];
+    MqttPacket packet;
+    
+    deviceIdsTxt(feedId, aid, c->ID, '.');
+    
+    if(OfframpReserve(d->parent, fabricNodenameBroadcast, fabricTaskIdService, fabricServiceIdState, feedId, &packet) != 0) {
+        // no packet buffer (MqttOptions::BufferSize) or it's in use
+        char* msg = MarshalValue(aid, c->ID, c->Format, c->Value, characteristicDecimals(c));
+        if(msg == 0) {
+            DTXT("deviceStatePublish(): marshal fail\n");
+            return -1;
+        }
+        
+        int ret = deviceFeedPublish(d, fabricNodenameBroadcast, fabricServiceIdState, feedId, msg, 1);
+        
+        os_free(msg);
+        
+        return ret;
+    }
+    
+    int len = MarshalValueInto(packet.Payload, packet.Size, aid, c->ID, c->Format, c->Value, characteristicDecimals(c));
+    if(len < 0) {
+        DTXT("deviceStatePublish(): marshal fail\n");
+    }
+    
+    return OfframpCommit(d->parent, &packet, len, d->qos, 1);
+}
+/**
+ * Publishes the retained state of 'c' if it changed and retained values are enabled
+ * @param d
+ * @param aid
+ * @param c
+ * @param changed
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceStateChanged(MqttDevice* d, sint64_t aid, Characteristic* c, bool changed)
+{
+    if(!changed || d->retainedValues == RetainedValuesOff) {
+        return 0;
+    }
+    
+    return deviceStatePublish(d, aid, c);
+}
+/**
+ * Publishes the retained states of the characteristics changed after 'since', e.g. by their getters while marshalling
+ * @param d
+ * @param since container sequence number
+ */
+void ICACHE_FLASH_ATTR deviceStatesSince(MqttDevice* d, uint32_t since)
+{
+    if(d->container == 0 || d->retainedValues == RetainedValuesOff) {
+        return;
+    }
+    
+    uint32_t count = d->container->seq - since;
+    
+    for(Accessory* a = d->container->Accessories; a != 0; a = a->next) {
+        for(Service* s = a->Service; s != 0; s = s->next) {
+            for(Characteristic* c = s->Characteristics; c != 0; c = c->next) {
+                if(c->seq - since - 1 < count) {
+                    deviceStatePublish(d, a->ID, c);
+                }
+            }
+        }
+    }
+}
+/**
+ * Publishes a single value; as a value message on its format feed or, addressed, as a bare value
+ * @param d
  * @param aid
  * @param iid
+ * @param format
+ * @param value
+ * @param decimals
  * @return 
  */
-int unmarshalValue(const char* msg, uint64_t* aid, uint64_t* iid)
+int ICACHE_FLASH_ATTR deviceValuePublish(MqttDevice* d, sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int decimals)
 {
-    int ret = -1;
+    char       feedId[2 * NUMBER_FORMAT_SIZE + CHARACTERISTIC_FORMAT_SIZE];
+    char       formatTxt[CHARACTERISTIC_FORMAT_SIZE];
+    MqttPacket packet;
+    int        len;
     
-    DTXT("unmarshalValue(): %s\n", msg);
+    // the format text may live in flash, the topic functions need it in RAM
+    flashStrcpy(formatTxt, characteristicFormatTxt(format), sizeof(formatTxt));
     
-    if(BMix_DecoderBegin(msg) != NULL) {
-        const char* _type;
+    if(d->addressedValues) {
+        int n = deviceIdsTxt(feedId, aid, iid, '/');
         
-        if(BMix_GetString("_type", &_type) != 0) {
-            DTXT("unmarshalValue(): '_type' not found\n");
-        } else if(BMix_GetU64("aid", aid) != 0) {
-            DTXT("unmarshalValue(): 'aid' not found\n");
-        } else if(BMix_GetU64("iid", iid) != 0) {
-            DTXT("unmarshalValue(): 'iid' not found\n");
-        } else {
-            DTXT("unmarshalValue(): all fields found\n");
+        feedId[n++] = '/';
+        os_strcpy(feedId + n, formatTxt);
+    } else if(d->cbor) {
+        os_sprintf(feedId, "%s" FeedIdCborSuffix, formatTxt);
+    } else {
+        os_strcpy(feedId, formatTxt);
+    }
+    
+    // the message is encoded straight into the connector's packet buffer
+    if(OfframpReserve(d->parent, NodenameControllers, fabricTaskIdService, fabricServiceIdToHK, feedId, &packet) != 0) {
+        // no packet buffer (MqttOptions::BufferSize) or it's in use
+        return deviceValuePublishHeap(d, aid, iid, format, value, decimals, feedId);
+    }
+    
+    if(d->addressedValues) {
+        len = MarshalBareValueInto(packet.Payload, packet.Size, format, value, decimals);
+    } else if(d->cbor) {
+        len = MarshalValueCborInto((uint8_t*) packet.Payload, packet.Size, aid, iid, format, value);
+    } else {
+        len = MarshalValueInto(packet.Payload, packet.Size, aid, iid, format, value, decimals);
+    }
+    
+    if(len < 0) {
+        DTXT("deviceValuePublish(): marshal fail\n");
+    }
+    
+    // releases the packet buffer also when marshalling failed
+    return OfframpCommit(d->parent, &packet, len, d->qos, 0);
+}
+/**
+ * deviceValuePublish() with the message marshalled on the heap
+ * @param d
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @param decimals
+ * @param feedId
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceValuePublishHeap(MqttDevice* d, sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int decimals, const char* feedId)
+{
+    char* msg;
+    int   len = 0;
+    
+    if(d->addressedValues) {
+        msg = MarshalBareValue(format, value, decimals);
+    } else if(d->cbor) {
+        msg = (char*) MarshalValueCbor(aid, iid, format, value, &len);
+    } else {
+        msg = MarshalValue(aid, iid, format, value, decimals);
+    }
+    
+    if(msg == 0) {
+        DTXT("deviceValuePublishHeap(): marshal fail\n");
+        return -1;
+    }
+    
+    if(!d->cbor || d->addressedValues) {
+        len = os_strlen(msg);
+    }
+    
+    int ret = deviceFeedPublishLen(d, NodenameControllers, fabricServiceIdToHK, feedId, msg, len, 0);
+    
+    os_free(msg);
+    
+    return ret;
+}
+/**
+ * Decodes a write addressed by its feed, "<aid>/<iid>/<format>", with the bare value as payload
+ * @param d
+ * @param feedId
+ * @param msg
+ * @param len
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceAddressedValue(MqttDevice* d, const char* feedId, char* msg, int len)
+{
+    sint64_t            ids[2] = {0, 0};
+    CharacteristicValue value;
+    const char*         p = feedId;
+    
+    for(int i = 0; i < 2; i++) {
+        if(*p < '0' || *p > '9') {
+            goto defer;
+        }
+        
+        while(*p >= '0' && *p <= '9') {
+            int digit = *p++ - '0';
+            
+            // ids are sint64_t; anything larger can't address a characteristic
+            if(ids[i] > (0x7FFFFFFFFFFFFFFFLL - digit) / 10) {
+                goto defer;
+            }
             
-            ret = 0;
+            ids[i] = ids[i] * 10 + digit;
+        }
+        
+        if(*p++ != '/') {
+            goto defer;
+        }
+    }
+    
+    CharacteristicFormat format = characteristicFormatByTxt(p);
+    
+    if(format == FormatNone || UnmarshalBareValue(msg, len, format, &value) != 0) {
+        goto defer;
+    }
+    
+    DTXT("deviceAddressedValue(): aid = %d, iid = %d, format = %d\n", (int) ids[0], (int) ids[1], format);
+    
+    deviceDispatch(d, ids[0], ids[1], format, &value);
+    
+    return 0;
+    
+defer:
+    DTXT("deviceAddressedValue(): unhandled message; feedId = '%s'\n", feedId);
+    
+    return -1;
+}
+/**
+ * Writes "<aid><sep><iid>"
+ * @param buf
+ * @param aid
+ * @param iid
+ * @param sep
+ * @return the length
+ */
+int ICACHE_FLASH_ATTR deviceIdsTxt(char* buf, sint64_t aid, sint64_t iid, char sep)
+{
+    int n = numberFormatInt(buf, aid);
+    
+    buf[n++] = sep;
+    
+    return n + numberFormatInt(buf + n, iid);
+}
+/**
+ * Publishes the full accessory list
+ * @param d
+ * @param nodename  destination nodename, fabricNodenameBroadcast or NodenameControllers
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceListPublish(MqttDevice* d, const char* nodename)
+{
+    const char* feedId;
+    char*       msg;
+    int         len;
+    int         ret;
+    uint32_t    since = (d->container != 0) ? d->container->seq : 0;
+    
+    // marshalling samples the getters
+    if(d->cbor) {
+        msg    = (char*) marshalContainerCbor(d->container, &len);
+        feedId = "list" FeedIdCborSuffix;
+    } else {
+        if(d->compactList) {
+            msg    = marshalContainerCompact(d->container);
+            feedId = "list" FeedIdCompactSuffix;
+        } else {
+            msg    = marshalContainer(d->container);
+            feedId = "list";
         }
+        
+        len = (msg != 0) ? os_strlen(msg) : 0;
+    }
+    
+    deviceStatesSince(d, since);
+    
+    if(msg == 0) {
+        DTXT("deviceListPublish(): marshal fail\n");
+        return -1;
     }
     
-    BMix_DecoderEnd();
+    DTXT("deviceListPublish(): len = %d\n", len);
+    
+    ret = deviceFeedPublishLen(d, nodename, fabricServiceIdAccessories, feedId, msg, len, 0);
+    
+    os_free(msg);
     
     return ret;
 }
+/**
+ * Publishes the current values of several characteristics as one "values" message
+ * @param d
+ * @param nodename  destination nodename, fabricNodenameBroadcast or NodenameControllers
+ * @param refs
+ * @param count
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceValuesPublish(MqttDevice* d, const char* nodename, CharacteristicRef* refs, int count)
+{
+    char* msg;
+    int   len;
+    int   ret;
+    
+    if(d->cbor) {
+        msg = (char*) MarshalValuesCbor(d->container, refs, count, &len);
+    } else {
+        msg = MarshalValues(d->container, refs, count);
+        len = (msg != 0) ? os_strlen(msg) : 0;
+    }
+    
+    if(msg == 0) {
+        DTXT("deviceValuesPublish(): marshal fail\n");
+        return -1;
+    }
+    
+    ret = deviceFeedPublishLen(d, nodename, fabricServiceIdToHK, d->cbor ? "values" FeedIdCborSuffix : "values", msg, len, 0);
+    
+    os_free(msg);
+    
+    return ret;
+}
+/**
+ * Decodes a CBOR message from feed "values.cbor" or "<format>.cbor"
+ * @param d
+ * @param feedId
+ * @param msg
+ * @param len
+ * @return 
+ */
+int ICACHE_FLASH_ATTR deviceCborValue(MqttDevice* d, const char* feedId, char* msg, int len)
+{
+    char         formatTxt[CHARACTERISTIC_FORMAT_SIZE];
+    ValueMessage v;
+    int          n = (int) os_strlen(feedId) - (int) (sizeof(FeedIdCborSuffix) - 1);
+    
+    // the suffix has to end the feed id, and what's in front of it has to fit
+    if(n < 0 || os_strcmp(feedId + n, FeedIdCborSuffix) != 0 || n >= (int) sizeof(formatTxt)) {
+        DTXT("deviceCborValue(): unhandled message; feedId = '%s'\n", feedId);
+        return -1;
+    }
+    
+    os_memcpy(formatTxt, feedId, n);
+    formatTxt[n] = '\0';
+    
+    if(os_strcmp(formatTxt, "values") == 0) {
+        int count = UnmarshalValuesCbor(d->container, (uint8_t*) msg, len, onValuesElement, d);
+        
+        DTXT("deviceCborValue(): %d values\n", count);
+        return (count < 0) ? -1 : 0;
+    }
+    
+    if(UnmarshalValueCbor((uint8_t*) msg, len, characteristicFormatByTxt(formatTxt), &v) != 0) {
+        DTXT("deviceCborValue(): unhandled message; feedId = '%s'\n", feedId);
+        return -1;
+    }
+    
+    DTXT("deviceCborValue(): aid = %d, iid = %d, format = %d\n", (int) v.Aid, (int) v.Iid, v.Format);
+    
+    deviceDispatch(d, v.Aid, v.Iid, v.Format, &v.Value);
+    
+    return 0;
+}
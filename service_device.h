@@ -39,12 +39,66 @@ extern "C" {
  *
  */
 
+// number of distinct characteristics a batch can hold before it is committed on its own
+#ifndef DEVICE_BATCH_SIZE
+#define DEVICE_BATCH_SIZE   8
+#endif
+
+// how often (milliseconds) the publish policies are checked for held back values and heartbeats
+#ifndef DEVICE_POLICY_TICK
+#define DEVICE_POLICY_TICK  100
+#endif
+
+// max. number of characteristics answered by one "read" request
+#ifndef DEVICE_READ_SIZE
+#define DEVICE_READ_SIZE    16
+#endif
+
+// max. number of controllers tracked for event subscriptions (at most 8, one bit each in Characteristic.subscribers)
+#ifndef DEVICE_CONTROLLERS
+#define DEVICE_CONTROLLERS  4
+#endif
+
+#if DEVICE_CONTROLLERS < 1 || DEVICE_CONTROLLERS > 8
+#error "DEVICE_CONTROLLERS must be 1 to 8"
+#endif
+
+typedef enum {
+    RetainedValuesOff,                  // values only go out on the to_hk feed
+    RetainedValuesAlso,                 // ... and on their retained state topic
+    RetainedValuesOnly                  // values only go out on their retained state topic
+} RetainedValues;
+
 typedef struct MqttDevice MqttDevice;
 
 struct MqttDevice {
     Mqtt*       parent;
     int         qos;
     Container*  container;
+    
+    int         coalesce;           // pending events are overwritten by newer values, see DeviceEnableCoalescing()
+    
+    int                 batching;   // DeviceBatchBegin() nesting level
+    int                 autoFlush;  // updates are batched until the next ConnectorRun() tick
+    int                 batchCount;
+    CharacteristicRef   batch[DEVICE_BATCH_SIZE];
+    
+    uint32_t            echoWindow; // see DeviceEnableEchoSuppression()
+    
+    int                 subscriptions;                  // only characteristics with subscribers are published
+    char*               controllers[DEVICE_CONTROLLERS];// nodenames of the subscribed controllers
+    
+    int                 retainedSchema; // see DeviceEnableRetainedSchema()
+    RetainedValues      retainedValues; // see DeviceEnableRetainedValues()
+    int                 addressedValues;// see DeviceEnableAddressedValues()
+    int                 cbor;           // see DeviceEnableCbor()
+    int                 compactList;    // see DeviceEnableCompactList()
+    int                 listPublished;  // the full accessory list went out since start
+    uint32_t            disconnectSeq;  // container seq when the connection was lost
+    
+    uint32_t            clockUs;    // millisecond clock derived from system_get_time(), see deviceMillis()
+    uint32_t            clockMs;
+    uint32_t            policyTick;
 };
 
 typedef struct Device_Message Device_Message;
@@ -63,8 +117,15 @@ struct Device_Message {
 #define Device_GetAid(m)            (m->aid)
 #define Device_GetIid(m)            (m->iid)
 #define Device_GetAcc(m)            (m->acc)
+#define Device_GetValueString(m)    (m->value.String)
 #define Device_GetValueBool(m)      (m->value.Bool)
 #define Device_GetValueUInt8(m)     (m->value.UInt8)
+#define Device_GetValueInt8(m)      (m->value.Int8)
+#define Device_GetValueUInt16(m)    (m->value.UInt16)
+#define Device_GetValueInt16(m)     (m->value.Int16)
+#define Device_GetValueUInt32(m)    (m->value.UInt32)
+#define Device_GetValueInt32(m)     (m->value.Int32)
+#define Device_GetValueUInt64(m)    (m->value.UInt64)
 #define Device_GetValueFloat(m)     (m->value.Float)
 
 /******************************************************************************************************************
@@ -102,6 +163,107 @@ CharacteristicFormat DeviceGetEventType(Device_Message* msg);
  * @param msg
  */
 void DeviceDeleteEvent(Device_Message* msg);
+/**
+ * In coalescing mode a new value from a controller overwrites a still pending event for the same aid/iid instead 
+ * of being appended, so the application only ever sees the latest value. Events are taken from a fixed pool of 
+ * 'slots'; with 'slots' <= 0 the pool gets one slot per writable characteristic in the container, and it fails if 
+ * there is none
+ * @param d
+ * @param slots
+ * @return 
+ */
+int DeviceEnableCoalescing(MqttDevice* d, int slots);
+/**
+ * Starts a batch; value updates are collected (one entry per characteristic, latest value wins) until the matching 
+ * DeviceBatchCommit() and then published as a single "values" message. Batches may be nested
+ * @param d
+ * @return 
+ */
+int DeviceBatchBegin(MqttDevice* d);
+/**
+ * 
+ * @param d
+ * @return 
+ */
+int DeviceBatchCommit(MqttDevice* d);
+/**
+ * With auto flush enabled every value update is batched and the batch is committed on the next ConnectorRun() tick
+ * @param d
+ * @param enable
+ * @return 
+ */
+int DeviceEnableAutoFlush(MqttDevice* d, int enable);
+/**
+ * With echo suppression enabled a SetValue*() that only confirms the value a controller wrote less than 'window' ms 
+ * earlier updates the characteristic but is not published. Note that other controllers then won't see the update 
+ * either. A 'window' of 0 disables it
+ * @param d
+ * @param window
+ * @return 
+ */
+int DeviceEnableEchoSuppression(MqttDevice* d, uint32_t window);
+/**
+ * In subscription mode value updates of a characteristic are only published while at least one controller has 
+ * subscribed to its events. Controllers (un)subscribe with a "subscribe"/"unsubscribe" message listing aid/iid pairs
+ * of characteristics with event permission; their subscriptions end when they go offline or restart
+ * @param d
+ * @param enable
+ * @return 
+ */
+int DeviceEnableSubscriptions(MqttDevice* d, int enable);
+/**
+ * With retained schema the accessory list is replaced by one retained document per accessory (feedId = aid) and a 
+ * retained index (feedId "index") on the accessories service. Controllers coming online find them at the broker, so 
+ * the device no longer republishes when a service controller comes online
+ * @param d
+ * @param enable
+ * @return 
+ */
+int DeviceEnableRetainedSchema(MqttDevice* d, int enable);
+/**
+ * With retained values every change of a value is (also) sent retained on a topic of its own, service "state" with 
+ * feedId "<aid>.<iid>", so controllers subscribing later get the current state straight from the broker. Publish 
+ * policies, subscriptions and echo suppression only apply to the to_hk feed, not to the retained state. Combined 
+ * with DeviceEnableRetainedSchema() nothing has to be republished when a controller comes online
+ * @param d
+ * @param mode
+ * @return 
+ */
+int DeviceEnableRetainedValues(MqttDevice* d, RetainedValues mode);
+/**
+ * With addressed values single value updates go out on feed "<aid>/<iid>/<format>" of to_hk with just the value as 
+ * payload, so the broker can filter per characteristic. Writes on from_hk in this form are always accepted
+ * @param d
+ * @param enable
+ * @return 
+ */
+int DeviceEnableAddressedValues(MqttDevice* d, int enable);
+/**
+ * With CBOR value messages, "values" messages and the accessory list are encoded in CBOR (see cbor.h) and sent on 
+ * their feed with FeedIdCborSuffix appended, e.g. "float.cbor", "values.cbor" and "list.cbor". CBOR writes on 
+ * from_hk are always accepted. Addressed values take precedence for single values
+ * @param d
+ * @param enable
+ * @return 
+ */
+int DeviceEnableCbor(MqttDevice* d, int enable);
+/**
+ * With the compact list the full accessory list is sent in the compact JSON profile of marshalContainerCompact(), on 
+ * feed "list" FeedIdCompactSuffix. For controllers that cannot take CBOR; CBOR takes precedence
+ * @param d
+ * @param enable
+ * @return 
+ */
+int DeviceEnableCompactList(MqttDevice* d, int enable);
+/**
+ * PublishAccessory republishes the schema of one accessory (and the index) after it has changed; without retained 
+ * schema the full accessory list is published. For an aid that is no longer in the container - the accessory was 
+ * removed or renumbered - its retained document is cleared instead
+ * @param d
+ * @param aid
+ * @return 
+ */
+int PublishAccessory(MqttDevice* d, sint64_t aid);
 /**
  * 
  * @param d
@@ -208,6 +370,29 @@ int setValue(MqttDevice* d, sint64_t aid, sint64_t iid, CharacteristicFormat for
  * @param d
  */
 void devicePublish(MqttDevice* d);
+/**
+ * Called when the connection to the broker is (re)established; publishes the full accessory list the first time, 
+ * afterwards only the changes made while disconnected (or the full list if the journal no longer covers them)
+ * @param d
+ */
+void deviceConnected(MqttDevice* d);
+/**
+ * 
+ * @param d
+ */
+void deviceDisconnected(MqttDevice* d);
+/**
+ * Called when a service controller reports its status
+ * @param d
+ * @param nodename
+ * @param online
+ */
+void deviceControllerStatus(MqttDevice* d, const char* nodename, int online);
+/**
+ * Called on every ConnectorRun() tick
+ * @param d
+ */
+void deviceRun(MqttDevice* d);
 /**
  * 
  * @param d
@@ -219,8 +404,9 @@ void deviceSubscribe(MqttDevice* d);
  * @param actorId
  * @param feedId
  * @param msg
+ * @param len
  */
-void onValueUpdate(MqttDevice* d, const char* actorId, const char* feedId, const char* msg);
+void onValueUpdate(MqttDevice* d, const char* actorId, const char* feedId, char* msg, int len);
 
 #ifdef	__cplusplus
 }
@@ -494,9 +494,12 @@ void ICACHE_FLASH_ATTR AddService(Accessory* a, Service* s)
         c->ID = a->idCount;
         a->idCount++;
         
+        c->parent = s;
         c = c->next;
     }
     
+    s->parent = a;
+    
     // now append the service
     if(a->Service != NULL) {
         Service* ptr = a->Service;
@@ -545,3 +548,22 @@ Characteristic* ICACHE_FLASH_ATTR FindCharacteristicByIid(Accessory* a, sint64_t
     
     return 0;
 }
+/**
+ * Controller writes to any characteristic of 'a' without a write callback of its own are applied and handed to 
+ * 'onWrite' in the same ConnectorRun() tick that decodes them, instead of being queued for DeviceGetEvent()
+ * @param a
+ * @param ptr
+ * @param onWrite
+ * @return 
+ */
+int ICACHE_FLASH_ATTR InstallAccessoryWriteCallback(Accessory* a, void* ptr, OnWriteCallback onWrite)
+{
+    if(a == 0) {
+        return -1;
+    }
+    
+    a->onWritePtr = ptr;
+    a->onWrite    = onWrite;
+    
+    return 0;
+}
@@ -52,6 +52,9 @@ struct Accessory {
     int                     Type;               // "type"
     Service*                Service;            // "services"
     
+    OnWriteCallback         onWrite;            // direct dispatch of controller writes, see InstallAccessoryWriteCallback()
+    void*                   onWritePtr;
+    
     int                     idCount;
     Accessory*              next;
     Container*              parent;
@@ -277,6 +280,15 @@ void AddService(Accessory* a, Service* s);
  * @return 
  */
 Characteristic* FindCharacteristicByIid(Accessory* a, sint64_t iid);
+/**
+ * Controller writes to any characteristic of 'a' without a write callback of its own are applied and handed to 
+ * 'onWrite' in the same ConnectorRun() tick that decodes them, instead of being queued for DeviceGetEvent()
+ * @param a
+ * @param ptr
+ * @param onWrite
+ * @return 
+ */
+int InstallAccessoryWriteCallback(Accessory* a, void* ptr, OnWriteCallback onWrite);
 
 /******************************************************************************************************************
  * 
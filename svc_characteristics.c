@@ -26,19 +26,23 @@
 
 #include "svc_characteristics.h"
 #include "service_device.h"
+#include "number_format.h"
 #include <osapi.h>
 #include <mem.h>
 
 #define DTXT(...)   os_printf(__VA_ARGS__)
 //#define DTXT(...)
 
+// the inline string storage follows the CharacteristicValue in the same heap block
+#define inlineString(c)     ((char*)((c)->Value + 1))
+
 /******************************************************************************************************************
  * 
  *
  */
 
 // characteristic units
-const char* CharacteristicUnits[] = {
+const char CharacteristicUnits[][CHARACTERISTIC_UNIT_SIZE] FLASH_STR_ATTR = {
     "percentage",
     "arcdegrees",
     "celsius",
@@ -47,7 +51,7 @@ const char* CharacteristicUnits[] = {
 };
 
 // characterisitic formats
-const char* CharacterisiticFormats[] = {
+const char CharacterisiticFormats[][CHARACTERISTIC_FORMAT_SIZE] FLASH_STR_ATTR = {
     "string",
     "bool",
     "float",
@@ -63,7 +67,7 @@ const char* CharacterisiticFormats[] = {
 };
 
 // characteristic types
-const char* CharacteristicTypes[] = {
+const char CharacteristicTypes[][CHARACTERISTIC_TYPE_SIZE] FLASH_STR_ATTR = {
     "57",   //  0
     "1",
     "64",
@@ -161,6 +165,19 @@ const char* CharacteristicTypes[] = {
  *
  */
 
+/**
+ * 
+ * @param format
+ * @param value
+ * @return 
+ */
+static double valueAsDouble(CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * 
+ * @param c
+ */
+static void characteristicJournal(Characteristic* c);
+
 /******************************************************************************************************************
  * public functions
  *
@@ -622,6 +639,271 @@ Characteristic* ICACHE_FLASH_ATTR NewCharacteristic(const char* typ)
     
     return c;
 }
+/**
+ * Controller writes to 'c' are applied and handed to 'onWrite' in the same ConnectorRun() tick that decodes them,
+ * instead of being queued for DeviceGetEvent()
+ * @param c
+ * @param ptr
+ * @param onWrite
+ * @return 
+ */
+int ICACHE_FLASH_ATTR InstallWriteCallback(Characteristic* c, void* ptr, OnWriteCallback onWrite)
+{
+    if(c == 0) {
+        return -1;
+    }
+    
+    c->onWritePtr = ptr;
+    c->onWrite    = onWrite;
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param ptr
+ * @param onRead
+ * @return 
+ */
+int ICACHE_FLASH_ATTR InstallReadCallback(Characteristic* c, void* ptr, OnReadCallback onRead)
+{
+    if(c == 0) {
+        return -1;
+    }
+    
+    c->onReadPtr = ptr;
+    c->onRead    = onRead;
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR characteristicRefresh(Characteristic* c)
+{
+    CharacteristicValue v;
+    
+    if(c->onRead == 0) {
+        return 0;
+    }
+    
+    if(c->onRead(c, &v, c->onReadPtr) != 0) {
+        return -1;
+    }
+    
+    return characteristicSetValue(c, c->Format, &v);
+}
+/**
+ * 
+ * @param c
+ * @param deadband
+ * @param deadbandRel
+ * @param minInterval
+ * @param maxSilence
+ * @param skipUnchanged
+ * @return 
+ */
+int ICACHE_FLASH_ATTR InstallPublishPolicy(Characteristic* c, double deadband, double deadbandRel, uint32_t minInterval, uint32_t maxSilence, bool skipUnchanged)
+{
+    if(c == 0) {
+        return -1;
+    }
+    
+    if(c->policy == 0) {
+        c->policy = (PublishPolicy*) os_zalloc(sizeof(PublishPolicy));
+        if(c->policy == 0) {
+            DTXT("InstallPublishPolicy(): mem fail\n");
+            return -1;
+        }
+    }
+    
+    c->policy->deadband      = deadband;
+    c->policy->deadbandRel   = deadbandRel;
+    c->policy->minInterval   = minInterval;
+    c->policy->maxSilence    = maxSilence;
+    c->policy->skipUnchanged = skipUnchanged;
+    
+    return 0;
+}
+/**
+ * 
+ * @param c
+ * @param format
+ * @param value
+ * @param now
+ * @return 
+ */
+PolicyVerdict ICACHE_FLASH_ATTR characteristicPolicyCheck(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value, uint32_t now)
+{
+    PublishPolicy* p = c->policy;
+    bool           changed;
+    
+    if(p == 0 || !p->published) {
+        return PolicyPublish;
+    }
+    
+    if(format == FormatString) {
+        changed = (c->Value == 0 || c->Value->String == 0 || value->String == 0 || os_strcmp(c->Value->String, value->String) != 0);
+    } else {
+        double v     = valueAsDouble(format, value);
+        double delta = (v > p->lastValue) ? v - p->lastValue : p->lastValue - v;
+        double band  = p->deadbandRel * ((p->lastValue < 0) ? -p->lastValue : p->lastValue);
+        
+        if(p->deadband > band) {
+            band = p->deadband;
+        }
+        
+        changed = (band > 0) ? (delta > band) : (delta != 0);
+        
+        if(!changed && band > 0) {
+            p->pending = false;                     // back near the published value; a held back one is stale
+            return PolicyDrop;                      // inside the deadband; the heartbeat still covers it
+        }
+    }
+    
+    if(!changed && p->skipUnchanged) {
+        p->pending = false;
+        return PolicyDrop;
+    }
+    
+    if(now - p->lastPublished < p->minInterval) {
+        p->pending = true;
+        return PolicyDefer;
+    }
+    
+    return PolicyPublish;
+}
+/**
+ * 
+ * @param c
+ * @param now
+ */
+void ICACHE_FLASH_ATTR characteristicPolicyPublished(Characteristic* c, uint32_t now)
+{
+    PublishPolicy* p = c->policy;
+    
+    if(p == 0) {
+        return;
+    }
+    
+    p->published     = true;
+    p->pending       = false;
+    p->lastPublished = now;
+    
+    if(c->Value != 0 && c->Format != FormatString) {
+        p->lastValue = valueAsDouble(c->Format, c->Value);
+    }
+}
+/**
+ * 
+ * @param c
+ * @param now
+ * @return 
+ */
+int ICACHE_FLASH_ATTR characteristicPolicyDue(Characteristic* c, uint32_t now)
+{
+    PublishPolicy* p = c->policy;
+    
+    if(p == 0 || !p->published || c->Value == 0) {
+        return 0;
+    }
+    
+    if(p->pending && now - p->lastPublished >= p->minInterval) {
+        return 1;
+    }
+    
+    if(p->maxSilence > 0 && now - p->lastPublished >= p->maxSilence) {
+        return 1;
+    }
+    
+    return 0;
+}
+/**
+ * String values are not tracked; their echo is always published
+ * @param c
+ * @param format
+ * @param value
+ * @param now
+ */
+void ICACHE_FLASH_ATTR characteristicNoteWrite(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value, uint32_t now)
+{
+    if(format == FormatString || format != c->Format) {
+        return;
+    }
+    
+    c->written      = true;
+    c->writtenAt    = now;
+    c->writtenValue = *value;
+}
+/**
+ * 
+ * @param c
+ * @param format
+ * @param value
+ * @param now
+ * @param window
+ * @return 
+ */
+int ICACHE_FLASH_ATTR characteristicIsEcho(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value, uint32_t now, uint32_t window)
+{
+    int echo;
+    
+    if(!c->written || format != c->Format) {
+        return 0;
+    }
+    
+    c->written = false;
+    
+    if(now - c->writtenAt >= window) {
+        return 0;
+    }
+    
+    switch(format) {
+        case FormatBool:    echo = (value->Bool   == c->writtenValue.Bool);    break;
+        case FormatUInt8:   echo = (value->UInt8  == c->writtenValue.UInt8);   break;
+        case FormatInt8:    echo = (value->Int8   == c->writtenValue.Int8);    break;
+        case FormatUInt16:  echo = (value->UInt16 == c->writtenValue.UInt16);  break;
+        case FormatInt16:   echo = (value->Int16  == c->writtenValue.Int16);   break;
+        case FormatUInt32:  echo = (value->UInt32 == c->writtenValue.UInt32);  break;
+        case FormatInt32:   echo = (value->Int32  == c->writtenValue.Int32);   break;
+        case FormatUInt64:  echo = (value->UInt64 == c->writtenValue.UInt64);  break;
+        case FormatFloat:   echo = (value->Float  == c->writtenValue.Float);   break;
+        default:            echo = 0;                                           break;
+    }
+    
+    return echo;
+}
+/**
+ * 
+ * @param c
+ * @param format
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR characteristicValueIs(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value)
+{
+    CharacteristicValue* v = c->Value;
+    
+    if(v == 0 || format != c->Format) {
+        return 0;
+    }
+    
+    switch(format) {
+        case FormatString:  return v->String != 0 && value->String != 0 && os_strcmp(v->String, value->String) == 0;
+        case FormatBool:    return value->Bool   == v->Bool;
+        case FormatUInt8:   return value->UInt8  == v->UInt8;
+        case FormatInt8:    return value->Int8   == v->Int8;
+        case FormatUInt16:  return value->UInt16 == v->UInt16;
+        case FormatInt16:   return value->Int16  == v->Int16;
+        case FormatUInt32:  return value->UInt32 == v->UInt32;
+        case FormatInt32:   return value->Int32  == v->Int32;
+        case FormatUInt64:  return value->UInt64 == v->UInt64;
+        case FormatFloat:   return value->Float  == v->Float;
+        default:            return 0;
+    }
+}
 /**
  * PermsAll returns read, write and event permissions
  * @return 
@@ -654,6 +936,83 @@ CharacteristicPerms ICACHE_FLASH_ATTR PermsWriteOnly(void)
 {
     return PermWrite;
 }
+/**
+ * Returns the format text (e.g. FormatFloatTxt) of a format - note that it may live in flash
+ * @param format
+ * @return 
+ */
+const char* ICACHE_FLASH_ATTR characteristicFormatTxt(CharacteristicFormat format)
+{
+    switch(format) {
+        case FormatString:  return FormatStringTxt;
+        case FormatBool:    return FormatBoolTxt;
+        case FormatUInt8:   return FormatUInt8Txt;
+        case FormatInt8:    return FormatInt8Txt;
+        case FormatUInt16:  return FormatUInt16Txt;
+        case FormatInt16:   return FormatInt16Txt;
+        case FormatUInt32:  return FormatUInt32Txt;
+        case FormatInt32:   return FormatInt32Txt;
+        case FormatUInt64:  return FormatUInt64Txt;
+        case FormatFloat:   return FormatFloatTxt;
+        case FormatNone:    break;
+    }
+    
+    return 0;
+}
+/**
+ * Picks the candidate from the first character, the length and the digit distinguishing the numeric formats, then 
+ * confirms it with a single compare
+ * @param txt
+ * @return 
+ */
+CharacteristicFormat ICACHE_FLASH_ATTR characteristicFormatByTxt(const char* txt)
+{
+    CharacteristicFormat format = FormatNone;
+    int                  len    = 0;
+    
+    if(txt == 0) {
+        return FormatNone;
+    }
+    
+    while(len < CHARACTERISTIC_FORMAT_SIZE && txt[len] != '\0') {
+        ++len;
+    }
+    
+    switch(txt[0]) {
+        case 's':   format = FormatString;  break;
+        case 'b':   format = FormatBool;    break;
+        case 'f':   format = FormatFloat;   break;
+        
+        case 'u':
+            if(len == 5) {
+                format = FormatUInt8;
+            } else if(len == 6) {
+                switch(txt[4]) {
+                    case '1':   format = FormatUInt16;  break;
+                    case '3':   format = FormatUInt32;  break;
+                    case '6':   format = FormatUInt64;  break;
+                }
+            }
+            break;
+            
+        case 'i':
+            if(len == 4) {
+                format = FormatInt8;
+            } else if(len == 5) {
+                switch(txt[3]) {
+                    case '1':   format = FormatInt16;   break;
+                    case '3':   format = FormatInt32;   break;
+                }
+            }
+            break;
+    }
+    
+    if(format == FormatNone || flashStrcmp(txt, characteristicFormatTxt(format)) != 0) {
+        return FormatNone;
+    }
+    
+    return format;
+}
 /**
  * 
  * @param c
@@ -663,8 +1022,18 @@ CharacteristicPerms ICACHE_FLASH_ATTR PermsWriteOnly(void)
  */
 int ICACHE_FLASH_ATTR characteristicSetValue(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value)
 {
+    if(value == 0) {
+        DTXT("characteristicSetValue(value): 'value' is nil\n");
+        return -1;
+    }
+
     if(c->Value == 0) {
-        c->Value  = (CharacteristicValue*) os_zalloc(sizeof(CharacteristicValue));
+        if(format == FormatString) {
+            c->Value = (CharacteristicValue*) os_zalloc(sizeof(CharacteristicValue) + CHARACTERISTIC_STRING_INLINE_SIZE);
+        } else {
+            c->Value = (CharacteristicValue*) os_zalloc(sizeof(CharacteristicValue));
+        }
+        
         if(c->Value == 0) {
             DTXT("characteristicSetValue(CharacteristicValue): mem fail\n");
             return -1;
@@ -673,10 +1042,6 @@ int ICACHE_FLASH_ATTR characteristicSetValue(Characteristic* c, CharacteristicFo
 
     switch(format) {
         case FormatString:
-            if(c->MaxLen != 0 && os_strlen(value->String) > *c->MaxLen) {
-                DTXT("characteristicSetValue(FormatString): truncate\n");
-                value->String[*c->MaxLen] = '\0';
-            }
             break;
             
         case FormatBool:
@@ -760,33 +1125,46 @@ int ICACHE_FLASH_ATTR characteristicSetValue(Characteristic* c, CharacteristicFo
             break;
     }
 
+    bool changed;
+    
+    if(format == FormatString) {
+        changed = (c->Value->String == 0 || value->String == 0 || os_strcmp(c->Value->String, value->String) != 0);
+    } else {
+        changed = (valueAsDouble(format, c->Value) != valueAsDouble(format, value));
+    }
+    
     switch(format) {
-        case FormatString:
-            if(c->Value->String != 0) {
-                os_free(c->Value->String);
+        case FormatString: {
+            char* old = c->Value->String;
+            int   len = (value->String != 0) ? os_strlen(value->String) : 0;
+            
+            if(c->MaxLen != 0 && len > *c->MaxLen) {
+                DTXT("characteristicSetValue(FormatString): truncate\n");
+                len = *c->MaxLen;                   // the callers string is left as is
             }
+            
+            if(len < CHARACTERISTIC_STRING_INLINE_SIZE) {
+                os_memmove(inlineString(c), value->String, len);
+                c->Value->String = inlineString(c);
+            } else {
+                c->Value->String = (char*) os_malloc(len + 1);
+                if(c->Value->String == 0) {
+                    DTXT("characteristicSetValue(char): mem fail\n");
+                    c->Value->String = old;         // keep the previous value
+                    return -1;
+                }
 
-            if(value == 0) {
-                DTXT("characteristicSetValue(value): 'value' is nil\n");
-                c->Value->String = 0;
-                return -1;
-            }
-            if(os_strlen(value->String) == 0) {
-                DTXT("characteristicSetValue(value): 'value' is zero-length\n");
-                c->Value->String = 0;
-                return -1;
+                os_memcpy(c->Value->String, value->String, len);
             }
 
-            c->Value->String = (char*) os_malloc(os_strlen(value->String) + 1);
-            if(c->Value->String == 0) {
-                DTXT("characteristicSetValue(char): mem fail\n");
-                os_free(c->Value);
-                c->Value = 0;
-                return -1;
-            }
+            c->Value->String[len] = '\0';
 
-            os_strcpy(c->Value->String, value->String);
+            // release the previous value when it lived in a block of its own
+            if(old != 0 && old != inlineString(c) && old != c->Value->String) {
+                os_free(old);
+            }
             break;
+        }
 
         case FormatBool:
             c->Value->Bool = value->Bool;
@@ -828,6 +1206,10 @@ int ICACHE_FLASH_ATTR characteristicSetValue(Characteristic* c, CharacteristicFo
             break;
     }
     
+    if(changed) {
+        characteristicJournal(c);
+    }
+    
     return 0;
 }
 /**
@@ -1011,6 +1393,7 @@ int ICACHE_FLASH_ATTR characteristicSetStepValue(Characteristic* c, Characterist
             
         case FormatFloat:
             c->StepValue->Float = value->Float;
+            c->decimals         = numberStepDecimals(value->Float);
             break;
             
         case FormatNone:
@@ -1019,5 +1402,58 @@ int ICACHE_FLASH_ATTR characteristicSetStepValue(Characteristic* c, Characterist
     
     return 0;
 }
+/**
+ * 
+ * @param c
+ * @return 
+ */
+int ICACHE_FLASH_ATTR characteristicDecimals(Characteristic* c)
+{
+    if(c->Format != FormatFloat || c->StepValue == 0) {
+        return NUMBER_DECIMALS_DEFAULT;
+    }
+    
+    return c->decimals;
+}
 
+/******************************************************************************************************************
+ * private functions
+ *
+ */
 
+/**
+ * 
+ * @param format
+ * @param value
+ * @return 
+ */
+double ICACHE_FLASH_ATTR valueAsDouble(CharacteristicFormat format, CharacteristicValue* value)
+{
+    switch(format) {
+        case FormatBool:    return value->Bool ? 1.0 : 0.0;
+        case FormatUInt8:   return value->UInt8;
+        case FormatInt8:    return value->Int8;
+        case FormatUInt16:  return value->UInt16;
+        case FormatInt16:   return value->Int16;
+        case FormatUInt32:  return value->UInt32;
+        case FormatInt32:   return value->Int32;
+        case FormatUInt64:  return (double) value->UInt64;
+        case FormatFloat:   return value->Float;
+        
+        case FormatString:
+        case FormatNone:
+            break;
+    }
+    
+    return 0.0;
+}
+/**
+ * Records a change in the journal of the container the characteristic belongs to (if it is part of one yet)
+ * @param c
+ */
+void ICACHE_FLASH_ATTR characteristicJournal(Characteristic* c)
+{
+    if(c->parent != 0 && c->parent->parent != 0 && c->parent->parent->parent != 0) {
+        containerJournal(c->parent->parent->parent, c);
+    }
+}
@@ -27,6 +27,7 @@
 #ifndef SVC_CHARACTERISTICS_H
 #define	SVC_CHARACTERISTICS_H
 
+#include "flash_strings.h"
 #include <github.com/mikejac/misc.esp8266-nonos.cpp/espmissingincludes.h>
 
 #ifdef	__cplusplus
@@ -39,6 +40,8 @@ extern "C" {
  */
 
 typedef struct Service Service;
+typedef struct Accessory Accessory;
+typedef struct Characteristic Characteristic;
 
 /******************************************************************************************************************
  * basic value types 
@@ -72,13 +75,43 @@ typedef union {
     double      Float;
 } CharacteristicValue;
 
+// string values shorter than this (terminating zero included) are kept inline in the
+// heap block holding the characteristic value - longer ones get a block of their own
+#ifndef CHARACTERISTIC_STRING_INLINE_SIZE
+#define CHARACTERISTIC_STRING_INLINE_SIZE       32
+#endif
+
 typedef enum {
     PermRead    = 0x01,     // can be read
     PermWrite   = 0x02,     // can be written
     PermEvents  = 0x04      // sends events
 } CharacteristicPerms;
 
-typedef struct Characteristic Characteristic;
+/**
+ * Called when a controller has written a new value; the value has already been applied to the characteristic
+ */
+typedef void (*OnWriteCallback)(Accessory* a, Characteristic* c, CharacteristicValue* value, void* ptr);
+typedef int  (*OnReadCallback)(Characteristic* c, CharacteristicValue* value, void* ptr);
+
+// when a value update is actually published, see InstallPublishPolicy(); times are in milliseconds
+typedef struct {
+    double                  deadband;           // absolute change required
+    double                  deadbandRel;        // change required relative to the last published value
+    uint32_t                minInterval;        // minimum time between two publishes
+    uint32_t                maxSilence;         // republish the current value after this long; 0 = never
+    bool                    skipUnchanged;      // don't publish a value identical to the last published one
+    
+    bool                    published;          // 'lastValue' and 'lastPublished' are valid
+    bool                    pending;            // the current value is newer than the last published one
+    double                  lastValue;
+    uint32_t                lastPublished;
+} PublishPolicy;
+
+typedef enum {
+    PolicyPublish,
+    PolicyDefer,                                // publish later, from the device tick
+    PolicyDrop
+} PolicyVerdict;
 
 struct Characteristic {
     sint64_t                ID;                 // "iid"
@@ -94,6 +127,22 @@ struct Characteristic {
     CharacteristicValue*    MaxValue;           // "maxValue,omitempty"
     CharacteristicValue*    MinValue;           // "minValue,omitempty"
     CharacteristicValue*    StepValue;          // "minStep,omitempty"
+    uint8_t                 decimals;           // FormatFloat digits after the point, from StepValue; see characteristicDecimals()
+
+    OnWriteCallback         onWrite;            // direct dispatch of controller writes, see InstallWriteCallback()
+    void*                   onWritePtr;
+    OnReadCallback          onRead;             // value getter, see InstallReadCallback()
+    void*                   onReadPtr;
+    
+    PublishPolicy*          policy;             // nil = every update is published
+    
+    uint32_t                seq;                // container sequence number of the last change, see containerJournal()
+    
+    uint8_t                 subscribers;        // controllers (one bit per slot) subscribed to events, see DeviceEnableSubscriptions()
+    
+    bool                    written;            // 'writtenValue' was written by a controller at 'writtenAt' (ms)
+    uint32_t                writtenAt;
+    CharacteristicValue     writtenValue;
 
     Characteristic*         next;
     Service*                parent;
@@ -307,6 +356,10 @@ ProgrammableSwitchOutputState* NewProgrammableSwitchOutputState(void);
 #define UnitLux                                 CharacteristicUnits[3]
 #define UnitSeconds                             CharacteristicUnits[4]
 
+#define CHARACTERISTIC_UNIT_SIZE                12
+
+extern const char CharacteristicUnits[][CHARACTERISTIC_UNIT_SIZE];
+
 // characterisitic formats
 #define FormatStringTxt                         CharacterisiticFormats[0]
 #define FormatBoolTxt                           CharacterisiticFormats[1]
@@ -321,7 +374,9 @@ ProgrammableSwitchOutputState* NewProgrammableSwitchOutputState(void);
 #define FormatInt8Txt                           CharacterisiticFormats[10]
 #define FormatInt16Txt                          CharacterisiticFormats[11]
 
-extern const char* CharacterisiticFormats[];
+#define CHARACTERISTIC_FORMAT_SIZE              8
+
+extern const char CharacterisiticFormats[][CHARACTERISTIC_FORMAT_SIZE];
 
 // characteristic types
 #define TypeAccessoryIdentifier                 CharacteristicTypes[0]
@@ -415,7 +470,9 @@ extern const char* CharacterisiticFormats[];
 #define TypeTunneledAccessoryStateNumber        CharacteristicTypes[88]
 #define TypeVersion                             CharacteristicTypes[89]
 
-extern const char* CharacteristicTypes[];
+#define CHARACTERISTIC_TYPE_SIZE                4
+
+extern const char CharacteristicTypes[][CHARACTERISTIC_TYPE_SIZE];
 
 /******************************************************************************************************************
  * prototypes
@@ -476,6 +533,15 @@ Characteristic* NewFloat(const char* typ);
  * @return 
  */
 Characteristic* NewCharacteristic(const char* typ);
+/**
+ * Controller writes to 'c' are applied and handed to 'onWrite' in the same ConnectorRun() tick that decodes them,
+ * instead of being queued for DeviceGetEvent()
+ * @param c
+ * @param ptr
+ * @param onWrite
+ * @return 
+ */
+int InstallWriteCallback(Characteristic* c, void* ptr, OnWriteCallback onWrite);
 /**
  * PermsAll returns read, write and event permissions
  * @return 
@@ -496,6 +562,98 @@ CharacteristicPerms PermsReadOnly(void);
  * @return 
  */
 CharacteristicPerms PermsWriteOnly(void);
+/**
+ * InstallReadCallback binds 'c' to a getter that is only invoked when the value is actually needed: when the 
+ * accessory list is marshalled, when a controller reads it and - with a publish policy that has a 'minInterval' or a 
+ * deadband - whenever the policy would allow a publish that somebody is subscribed to; otherwise only for the 
+ * 'maxSilence' heartbeat. 'onRead' fills in the value and returns 0, or returns -1 to keep the current value
+ * @param c
+ * @param ptr
+ * @param onRead
+ * @return 
+ */
+int InstallReadCallback(Characteristic* c, void* ptr, OnReadCallback onRead);
+/**
+ * Fetches the value of 'c' from its getter, if it has one; a change is journaled like any other, which is how the
+ * device finds the retained states to update
+ * @param c
+ * @return 
+ */
+int characteristicRefresh(Characteristic* c);
+/**
+ * InstallPublishPolicy filters the value updates of 'c' before they are published. A numeric update is published 
+ * when it differs from the last published value by more than 'deadband' or 'deadbandRel' (a fraction of that value),
+ * but never sooner than 'minInterval' after the previous publish - the latest value is then held back and sent once 
+ * the interval has passed. After 'maxSilence' without a publish the current value is sent anyway
+ * @param c
+ * @param deadband
+ * @param deadbandRel
+ * @param minInterval
+ * @param maxSilence
+ * @param skipUnchanged
+ * @return 
+ */
+int InstallPublishPolicy(Characteristic* c, double deadband, double deadbandRel, uint32_t minInterval, uint32_t maxSilence, bool skipUnchanged);
+/**
+ * Decides what to do with a value update; must be called before the value is stored
+ * @param c
+ * @param format
+ * @param value
+ * @param now
+ * @return 
+ */
+PolicyVerdict characteristicPolicyCheck(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value, uint32_t now);
+/**
+ * Records that the current value of 'c' has been published
+ * @param c
+ * @param now
+ */
+void characteristicPolicyPublished(Characteristic* c, uint32_t now);
+/**
+ * Returns 1 if a held back value or a heartbeat is due
+ * @param c
+ * @param now
+ * @return 
+ */
+int characteristicPolicyDue(Characteristic* c, uint32_t now);
+/**
+ * Remembers a value written by a controller so its echo can be recognized, see characteristicIsEcho()
+ * @param c
+ * @param format
+ * @param value
+ * @param now
+ */
+void characteristicNoteWrite(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value, uint32_t now);
+/**
+ * Returns 1 if 'value' is the value a controller wrote less than 'window' ms ago; the write is only matched once
+ * @param c
+ * @param format
+ * @param value
+ * @param now
+ * @param window
+ * @return 
+ */
+int characteristicIsEcho(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value, uint32_t now, uint32_t window);
+/**
+ * Returns 1 if 'value' is the current value of 'c'
+ * @param c
+ * @param format
+ * @param value
+ * @return 
+ */
+int characteristicValueIs(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * Returns the format text (e.g. FormatFloatTxt) of a format - note that it may live in flash
+ * @param format
+ * @return 
+ */
+const char* characteristicFormatTxt(CharacteristicFormat format);
+/**
+ * Maps a format text (e.g. "uint16") to its format; FormatNone if unknown or not a value format ("data", "tlv8")
+ * @param txt
+ * @return 
+ */
+CharacteristicFormat characteristicFormatByTxt(const char* txt);
 /**
  * 
  * @param c
@@ -528,6 +686,12 @@ int characteristicSetMaxValue(Characteristic* c, CharacteristicFormat format, Ch
  * @return 
  */
 int characteristicSetStepValue(Characteristic* c, CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * 
+ * @param c
+ * @return the number of decimals FormatFloat values of 'c' are written with
+ */
+int characteristicDecimals(Characteristic* c);
 
 #ifdef	__cplusplus
 }
@@ -25,6 +25,9 @@
  */
 
 #include "svc_container.h"
+#include "json_scan.h"
+#include "cbor.h"
+#include "number_format.h"
 #include <github.com/mikejac/realtimelogic.json.esp8266-nonos.cpp/JEncoder.h>
 #include <osapi.h>
 #include <mem.h>
@@ -32,6 +35,38 @@
 #define DTXT(...)   os_printf(__VA_ARGS__)
 //#define DTXT(...)
 
+// large enough for a full 128-bit UUID type
+#define TYPE_TXT_SIZE       40
+
+// MarshalValueCbor() without the text of a string value: map head, "aid" and "iid" with 64-bit integers, "value" 
+// and the longest item head (a uint64 or the length of a string)
+#define CBOR_VALUE_SIZE     (1 + (1 + 3) + 9 + (1 + 3) + 9 + (1 + 5) + 9)
+
+// key names and encoding of the accessory schema
+typedef struct {
+    const char* aid;
+    const char* type;
+    const char* services;
+    const char* iid;
+    const char* characteristics;
+    const char* perms;
+    const char* value;
+    const char* format;
+    const char* unit;
+    const char* maxValue;
+    const char* minValue;
+    const char* minStep;
+    int         compact;        // perms as a bitmask of CharacteristicPerms, format as a CharacteristicFormat
+} MarshalProfile;
+
+static const MarshalProfile verboseProfile = {
+    "aid", "type", "services", "iid", "characteristics", "perms", "value", "format", "unit", "maxValue", "minValue", "minStep", 0
+};
+
+static const MarshalProfile compactProfile = {
+    "i", "t", "s", "i", "c", "p", "v", "f", "u", "x", "m", "s", 1
+};
+
 /******************************************************************************************************************
  * prototypes
  *
@@ -41,39 +76,151 @@
  * 
  * @param o
  * @param a
+ * @param p
  * @return 
  */
-static int marshalAccessory(JEncoder* o, Accessory* a);
+static int marshalAccessory(JEncoder* o, Accessory* a, const MarshalProfile* p);
 /**
  * 
  * @param o
  * @param s
+ * @param p
  * @return 
  */
-static int marshalService(JEncoder* o, Service* s);
+static int marshalService(JEncoder* o, Service* s, const MarshalProfile* p);
 /**
  * 
  * @param o
  * @param c
+ * @param p
  * @return 
  */
-static int marshalCharacteristic(JEncoder* o, Characteristic* c);
+static int marshalCharacteristic(JEncoder* o, Characteristic* c, const MarshalProfile* p);
 /**
  * 
  * @param o
  * @param name
  * @param format
  * @param value
+ * @param decimals
+ * @return 
+ */
+static int marshalValue_private(JEncoder* o, const char* name, CharacteristicFormat format, CharacteristicValue* value, int decimals);
+/**
+ * 
+ * @param o
+ * @param format
+ * @param value
+ * @param decimals FormatFloat digits after the point
+ * @return 
+ */
+static int marshalValueItem(JEncoder* o, CharacteristicFormat format, CharacteristicValue* value, int decimals);
+/**
+ * 
+ * @param w
+ * @param format
+ * @param value
+ */
+static void cborValueItem(CBOR_WRITER* w, CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * 
+ * @param w
+ * @param a
+ */
+static void cborAccessory(CBOR_WRITER* w, Accessory* a);
+/**
+ * 
+ * @param w
+ * @param c
+ */
+static void cborCharacteristic(CBOR_WRITER* w, Characteristic* c);
+/**
+ * 
+ * @param r
+ * @param pairs
+ * @param v
+ * @param value
+ * @return 
+ */
+static int cborValueMembers(CBOR_READER* r, int pairs, ValueMessage* v, CBOR_ITEM* value);
+/**
+ * 
+ * @param item
+ * @param format
+ * @param value
+ * @return 
+ */
+static int cborValue_private(CBOR_ITEM* item, CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * 
+ * @param s
+ * @param v
+ * @param value
+ * @param envelope 1 if a "d" envelope may follow, it is accepted once
+ * @return 
+ */
+static int unmarshalValueMembers(JSON_SCAN* s, ValueMessage* v, JSON_ITEM* value, int envelope);
+/**
+ * 
+ * @param s
+ * @param cont
+ * @param onValue
+ * @param ptr
+ * @param count
+ * @param envelope 1 if a "d" envelope may follow, it is accepted once
+ * @return 
+ */
+static int unmarshalValuesMembers(JSON_SCAN* s, Container* cont, OnValueMessage onValue, void* ptr, int* count, int envelope);
+/**
+ * 
+ * @param s
+ * @param cont
+ * @param refs
+ * @param max
+ * @param count
+ * @param envelope 1 if a "d" envelope may follow, it is accepted once
+ * @return 
+ */
+static int unmarshalIdsMembers(JSON_SCAN* s, Container* cont, CharacteristicRef* refs, int max, int* count, int envelope);
+/**
+ * 
+ * @param s
+ * @param seq
+ * @param envelope 1 if a "d" envelope may follow, it is accepted once
+ * @return 
+ */
+static int unmarshalSeqMembers(JSON_SCAN* s, sint64_t* seq, int envelope);
+/**
+ * 
+ * @param item
+ * @param format
+ * @param value
+ * @return 
+ */
+static int unmarshalValue_private(JSON_ITEM* item, CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * 
+ * @param format
+ * @param u
+ * @param value
+ * @return 
+ */
+static int valueFromUInt64(CharacteristicFormat format, uint64_t u, CharacteristicValue* value);
+/**
+ * 
+ * @param format
+ * @param i
+ * @param value
  * @return 
  */
-static int marshalValue_private(JEncoder* o, const char* name, CharacteristicFormat format, CharacteristicValue* value);
+static int valueFromInt64(CharacteristicFormat format, sint64_t i, CharacteristicValue* value);
 /**
  * 
  * @param o
  * @param sizeRequired
  * @return 
  */
-static int _BufPrint_flush(BufPrint* o, int sizeRequired);
+static int _BufPrint_full(BufPrint* o, int sizeRequired);
 
 /******************************************************************************************************************
  * public functions
@@ -179,23 +326,48 @@ Accessory* ICACHE_FLASH_ATTR FindByAid(Container* cont, sint64_t aid)
  * @param iid
  * @param format
  * @param value
+ * @param decimals
+ * @return 
+ */
+char* ICACHE_FLASH_ATTR MarshalValue(sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int decimals)
+{
+    char* b = (char*) os_malloc(1024);
+    if(b == 0) {
+        DTXT("MarshalValue(malloc): mem fail");
+        return 0;
+    }
+    
+    if(MarshalValueInto(b, 1024, aid, iid, format, value, decimals) < 0) {
+        os_free(b);
+        return 0;
+    }
+    
+    return b;
+}
+/**
+ * 
+ * @param buf
+ * @param size
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @param decimals
  * @return 
  */
-char* ICACHE_FLASH_ATTR MarshalValue(sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value)
+int ICACHE_FLASH_ATTR MarshalValueInto(char* buf, int size, sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int decimals)
 {
     JEncoder o;
     JErr     err;
     BufPrint out;
-    char*    b;
+    char     txt[CHARACTERISTIC_FORMAT_SIZE];
     
-    b = (char*) os_malloc(1024);
-    if(b == 0) {
-        DTXT("MarshalValue(malloc): mem fail");
-        return 0;
+    if(size < 2) {
+        return -1;
     }
     
-    BufPrint_constructor(&out, NULL, _BufPrint_flush);
-    BufPrint_setBuf(&out, b, 1024);
+    BufPrint_constructor(&out, NULL, _BufPrint_full);
+    BufPrint_setBuf(&out, buf, size - 1);   // room for the zero-termination
     
     JErr_constructor(&err);
     
@@ -207,339 +379,1717 @@ char* ICACHE_FLASH_ATTR MarshalValue(sint64_t aid, sint64_t iid, CharacteristicF
     JEncoder_setName(&o, "d");    
     JEncoder_beginObject(&o);
     
-    JEncoder_setName(&o, "_type");
-    switch(format) {
-        case FormatString:
-            JEncoder_setString(&o, FormatStringTxt);
-            break;
-
-        case FormatBool:
-            JEncoder_setString(&o, FormatBoolTxt);
-            break;
-            
-        case FormatUInt8:
-            JEncoder_setString(&o, FormatUInt8Txt);
-            break;
-            
-        case FormatInt8:
-            JEncoder_setString(&o, FormatInt8Txt);
-            break;
-            
-        case FormatUInt16:
-            JEncoder_setString(&o, FormatUInt16Txt);
-            break;
-            
-        case FormatInt16:
-            JEncoder_setString(&o, FormatInt16Txt);
-            break;
-            
-        case FormatUInt32:
-            JEncoder_setString(&o, FormatUInt32Txt);
-            break;
-            
-        case FormatInt32:
-            JEncoder_setString(&o, FormatInt32Txt);
-            break;
-            
-        case FormatUInt64:
-            JEncoder_setString(&o, FormatUInt64Txt);
-            break;
-            
-        case FormatFloat:   
-            JEncoder_setString(&o, FormatFloatTxt);
-            break;
-            
-        case FormatNone:
-            break;
+    if(characteristicFormatTxt(format) != 0) {
+        JEncoder_setName(&o, "_type");
+        JEncoder_setString(&o, flashStrcpy(txt, characteristicFormatTxt(format), sizeof(txt)));
     }
 
     JEncoder_setName(&o, "aid");  JEncoder_setLong(&o, aid);
     JEncoder_setName(&o, "iid");  JEncoder_setLong(&o, iid);
 
-    marshalValue_private(&o, "value", format, value);
+    marshalValue_private(&o, "value", format, value, decimals);
 
     // end the object
     JEncoder_endObject(&o);     // "d"
     JEncoder_endObject(&o);
     
     if(JErr_isError(&err)) {
-        DTXT("MarshalValue(): fail; err = %s\n", JErr_getErrS(&err));
-        os_free(b);
-        
-        return 0;
-    } else {
-        JEncoder_commit(&o);    // this will activate _BufPrint_flush()
-        
-        return b;
+        DTXT("MarshalValueInto(): fail; err = %s\n", JErr_getErrS(&err));
+        return -1;
+    }
+    
+    JEncoder_commit(&o);        // this will activate _BufPrint_full()
+    
+    if(JErr_isError(&err)) {
+        return -1;
     }
     
+    return os_strlen(buf);
 }
 /**
  * 
  * @param cont
+ * @param refs
+ * @param count
  * @return 
  */
-char* ICACHE_FLASH_ATTR marshalContainer(Container* cont)
+char* ICACHE_FLASH_ATTR MarshalValues(Container* cont, CharacteristicRef* refs, int count)
 {
     JEncoder o;
     JErr     err;
     BufPrint out;
     char*    b;
+    char     txt[CHARACTERISTIC_FORMAT_SIZE];
+    int      i;
     
     b = (char*) os_malloc(cont->marshalBufferSize);
     if(b == 0) {
-        DTXT("MarshalContainer(malloc): mem fail");
+        DTXT("MarshalValues(malloc): mem fail");
         return 0;
     }
     
-    BufPrint_constructor(&out, NULL, _BufPrint_flush);
-    BufPrint_setBuf(&out, b, cont->marshalBufferSize);
+    BufPrint_constructor(&out, NULL, _BufPrint_full);
+    BufPrint_setBuf(&out, b, cont->marshalBufferSize - 1);     // room for the zero-termination
     
     JErr_constructor(&err);
     
     JEncoder_constructor(&o, &err, &out);
-    
+
+    // begin the object
     JEncoder_beginObject(&o);
     
     JEncoder_setName(&o, "d");    
     JEncoder_beginObject(&o);
     
-    JEncoder_setName(&o, "_type");          JEncoder_setString(&o, "accessories_list");
-    JEncoder_setName(&o, "nodename");       JEncoder_setString(&o, cont->Nodename);
-    JEncoder_setName(&o, "name");           JEncoder_setString(&o, cont->Name);
-    JEncoder_setName(&o, "model");          JEncoder_setString(&o, cont->Model);
-    JEncoder_setName(&o, "serialnumber");   JEncoder_setString(&o, cont->SerialNumber);
-    JEncoder_setName(&o, "manufacturer");   JEncoder_setString(&o, cont->Manufacturer);
-
-    JEncoder_setName(&o, "value");
-    JEncoder_beginObject(&o);
+    JEncoder_setName(&o, "_type");
+    JEncoder_setString(&o, "values");
     
-    JEncoder_setName(&o, "accessories");
+    JEncoder_setName(&o, "seq");
+    JEncoder_setLong(&o, cont->seq);
+    
+    JEncoder_setName(&o, "values");
     JEncoder_beginArray(&o);
     
-    for(Accessory* a = cont->Accessories; a != NULL; a = a->next) {
-        marshalAccessory(&o, a);
+    for(i = 0; i < count; i++) {
+        Characteristic* c = refs[i].C;
+        
+        JEncoder_beginObject(&o);
+
+        JEncoder_setName(&o, "aid");  JEncoder_setLong(&o, refs[i].Aid);
+        JEncoder_setName(&o, "iid");  JEncoder_setLong(&o, c->ID);
+
+        if(characteristicFormatTxt(c->Format) != 0) {
+            JEncoder_setName(&o, "format");
+            JEncoder_setString(&o, flashStrcpy(txt, characteristicFormatTxt(c->Format), sizeof(txt)));
+        }
+        
+        marshalValue_private(&o, "value", c->Format, c->Value, characteristicDecimals(c));
+        
+        JEncoder_endObject(&o);
     }
     
-    JEncoder_endArray(&o);      // "accessories"
-    
-    JEncoder_endObject(&o);     // "value"
+    JEncoder_endArray(&o);      // "values"
+
+    // end the object
     JEncoder_endObject(&o);     // "d"
     JEncoder_endObject(&o);
     
     if(JErr_isError(&err)) {
-        DTXT("MarshalContainer(): fail; err = %s\n", JErr_getErrS(&err));
+        DTXT("MarshalValues(): fail; err = %s\n", JErr_getErrS(&err));
         os_free(b);
         
         return 0;
     } else {
-        JEncoder_commit(&o);    // this will activate _BufPrint_flush()
-        DTXT("MarshalContainer(): b = %s\n", b);
+        JEncoder_commit(&o);    // this will activate _BufPrint_full()
         
         return b;
     }
 }
 /**
  * 
- * @param o
- * @param a
+ * @param msg
+ * @param len
+ * @param feedId
+ * @param v
  * @return 
  */
-int ICACHE_FLASH_ATTR marshalAccessory(JEncoder* o, Accessory* a)
+int ICACHE_FLASH_ATTR UnmarshalValue(char* msg, int len, const char* feedId, ValueMessage* v)
 {
-    JEncoder_beginObject(o);
-    JEncoder_setName(o, "aid");  JEncoder_setLong(o, a->ID);
-    JEncoder_setName(o, "type"); JEncoder_setInt(o, a->Type);
-
-    JEncoder_setName(o, "services");
-    JEncoder_beginArray(o);
-
-    for(Service* svc = a->Service; svc != NULL; svc = svc->next) {
-        marshalService(o, svc);
+    JSON_SCAN s;
+    JSON_ITEM value;
+    
+    if(msg == 0 || v == 0) {
+        DTXT("UnmarshalValue(): 'msg' or 'v' is nil\n");
+        return -1;
     }
-
-    JEncoder_endArray(o);   // "services"
-    JEncoder_endObject(o);
-
-    return 0;
+    
+    v->Type   = 0;
+    v->Aid    = -1;
+    v->Iid    = -1;
+    v->Format = FormatNone;
+    
+    value.kind = JsonNone;
+    
+    if(scanBegin(&s, msg, len) != 0 || scanObject(&s) != 0 || unmarshalValueMembers(&s, v, &value, 1) != 0) {
+        DTXT("UnmarshalValue(): malformed message\n");
+        return -1;
+    }
+    
+    if(v->Aid < 0 || v->Iid < 0 || value.kind == JsonNone) {
+        DTXT("UnmarshalValue(): 'aid', 'iid' or 'value' not found\n");
+        return -1;
+    }
+    
+    v->Format = characteristicFormatByTxt(feedId);
+    
+    if(v->Format == FormatNone) {
+        v->Format = characteristicFormatByTxt(v->Type);
+    }
+    
+    if(v->Format == FormatNone) {
+        DTXT("UnmarshalValue(): unknown format\n");
+        return -1;
+    }
+    
+    return unmarshalValue_private(&value, v->Format, &v->Value);
 }
 /**
  * 
- * @param o
- * @param s
+ * @param cont
+ * @param msg
+ * @param len
+ * @param onValue
+ * @param ptr
  * @return 
  */
-int ICACHE_FLASH_ATTR marshalService(JEncoder* o, Service* s)
+int ICACHE_FLASH_ATTR UnmarshalValues(Container* cont, char* msg, int len, OnValueMessage onValue, void* ptr)
 {
-    JEncoder_beginObject(o);
-    JEncoder_setName(o, "iid");  JEncoder_setLong(o, s->ID);
-    JEncoder_setName(o, "type"); JEncoder_setString(o, s->Type);
-
-    JEncoder_setName(o, "characteristics");
-    JEncoder_beginArray(o);
-
-    for(Characteristic* ch = s->Characteristics; ch != NULL; ch = ch->next) {
-        marshalCharacteristic(o, ch);
+    JSON_SCAN s;
+    int       count = 0;
+    
+    if(cont == 0 || msg == 0 || onValue == 0) {
+        DTXT("UnmarshalValues(): 'cont', 'msg' or 'onValue' is nil\n");
+        return -1;
     }
-
-    JEncoder_endArray(o);       // "characteristics"
-    JEncoder_endObject(o);
-
-    return 0;
+    
+    if(scanBegin(&s, msg, len) != 0 || scanObject(&s) != 0 || unmarshalValuesMembers(&s, cont, onValue, ptr, &count, 1) != 0) {
+        DTXT("UnmarshalValues(): malformed message; %d values decoded\n", count);
+        return -1;
+    }
+    
+    return count;
 }
 /**
  * 
- * @param o
- * @param c
+ * @param cont
+ * @param a
  * @return 
  */
-int ICACHE_FLASH_ATTR marshalCharacteristic(JEncoder* o, Characteristic* c)
+char* ICACHE_FLASH_ATTR MarshalAccessory(Container* cont, Accessory* a)
 {
-    JEncoder_beginObject(o);
-    JEncoder_setName(o, "iid");  JEncoder_setLong(o, c->ID);
-    JEncoder_setName(o, "type"); JEncoder_setString(o, c->Type);
-
-    // perms
-    JEncoder_setName(o, "perms");
-    JEncoder_beginArray(o);
-
-    if((c->Perms & PermRead) == PermRead) {
-        JEncoder_setString(o, "pr");
-    }
-    if((c->Perms & PermWrite) == PermWrite) {
-        JEncoder_setString(o, "pw");
-    }
-    if((c->Perms & PermEvents) == PermEvents) {
-        JEncoder_setString(o, "ev");
+    JEncoder o;
+    JErr     err;
+    BufPrint out;
+    char*    b;
+    
+    b = (char*) os_malloc(cont->marshalBufferSize);
+    if(b == 0) {
+        DTXT("MarshalAccessory(malloc): mem fail");
+        return 0;
     }
     
-    JEncoder_endArray(o);       // "perms"
-
-    // value - optional
-    marshalValue_private(o, "value", c->Format, c->Value);
-
-    // format
-    JEncoder_setName(o, "format");
-
-    switch(c->Format) {
-        case FormatString:  
-            JEncoder_setString(o, FormatStringTxt);    
-            break;
-        case FormatBool:    
-            JEncoder_setString(o, FormatBoolTxt);    
+    BufPrint_constructor(&out, NULL, _BufPrint_full);
+    BufPrint_setBuf(&out, b, cont->marshalBufferSize - 1);     // room for the zero-termination
+    
+    JErr_constructor(&err);
+    
+    JEncoder_constructor(&o, &err, &out);
+    
+    JEncoder_beginObject(&o);
+    
+    JEncoder_setName(&o, "d");    
+    JEncoder_beginObject(&o);
+    
+    JEncoder_setName(&o, "_type");          JEncoder_setString(&o, "accessory");
+    JEncoder_setName(&o, "nodename");       JEncoder_setString(&o, cont->Nodename);
+    JEncoder_setName(&o, "seq");            JEncoder_setLong(&o, cont->seq);
+
+    JEncoder_setName(&o, "value");
+    marshalAccessory(&o, a, &verboseProfile);
+    
+    JEncoder_endObject(&o);     // "d"
+    JEncoder_endObject(&o);
+    
+    if(JErr_isError(&err)) {
+        DTXT("MarshalAccessory(): fail; err = %s\n", JErr_getErrS(&err));
+        os_free(b);
+        
+        return 0;
+    } else {
+        JEncoder_commit(&o);    // this will activate _BufPrint_full()
+        
+        return b;
+    }
+}
+/**
+ * 
+ * @param cont
+ * @return 
+ */
+char* ICACHE_FLASH_ATTR MarshalIndex(Container* cont)
+{
+    JEncoder o;
+    JErr     err;
+    BufPrint out;
+    char*    b;
+    
+    b = (char*) os_malloc(cont->marshalBufferSize);
+    if(b == 0) {
+        DTXT("MarshalIndex(malloc): mem fail");
+        return 0;
+    }
+    
+    BufPrint_constructor(&out, NULL, _BufPrint_full);
+    BufPrint_setBuf(&out, b, cont->marshalBufferSize - 1);     // room for the zero-termination
+    
+    JErr_constructor(&err);
+    
+    JEncoder_constructor(&o, &err, &out);
+    
+    JEncoder_beginObject(&o);
+    
+    JEncoder_setName(&o, "d");    
+    JEncoder_beginObject(&o);
+    
+    JEncoder_setName(&o, "_type");          JEncoder_setString(&o, "accessories_index");
+    JEncoder_setName(&o, "nodename");       JEncoder_setString(&o, cont->Nodename);
+    JEncoder_setName(&o, "name");           JEncoder_setString(&o, cont->Name);
+    JEncoder_setName(&o, "model");          JEncoder_setString(&o, cont->Model);
+    JEncoder_setName(&o, "serialnumber");   JEncoder_setString(&o, cont->SerialNumber);
+    JEncoder_setName(&o, "manufacturer");   JEncoder_setString(&o, cont->Manufacturer);
+    JEncoder_setName(&o, "seq");            JEncoder_setLong(&o, cont->seq);
+
+    JEncoder_setName(&o, "aids");
+    JEncoder_beginArray(&o);
+    
+    for(Accessory* a = cont->Accessories; a != NULL; a = a->next) {
+        JEncoder_setLong(&o, a->ID);
+    }
+    
+    JEncoder_endArray(&o);      // "aids"
+    
+    JEncoder_endObject(&o);     // "d"
+    JEncoder_endObject(&o);
+    
+    if(JErr_isError(&err)) {
+        DTXT("MarshalIndex(): fail; err = %s\n", JErr_getErrS(&err));
+        os_free(b);
+        
+        return 0;
+    } else {
+        JEncoder_commit(&o);    // this will activate _BufPrint_full()
+        
+        return b;
+    }
+}
+/**
+ * 
+ * @param msg
+ * @param len
+ * @param seq
+ * @return 
+ */
+int ICACHE_FLASH_ATTR UnmarshalSeq(char* msg, int len, uint32_t* seq)
+{
+    JSON_SCAN s;
+    sint64_t  v = -1;
+    
+    if(msg == 0 || seq == 0) {
+        DTXT("UnmarshalSeq(): 'msg' or 'seq' is nil\n");
+        return -1;
+    }
+    
+    if(scanBegin(&s, msg, len) != 0 || scanObject(&s) != 0 || unmarshalSeqMembers(&s, &v, 1) != 0 || v < 0) {
+        DTXT("UnmarshalSeq(): malformed message\n");
+        return -1;
+    }
+    
+    *seq = (uint32_t) v;
+    
+    return 0;
+}
+/**
+ * 
+ * @param cont
+ * @param since
+ * @param refs
+ * @return 
+ */
+int ICACHE_FLASH_ATTR ContainerChanges(Container* cont, uint32_t since, CharacteristicRef* refs)
+{
+    int      count = 0;
+    uint32_t seq;
+    
+    if(since == cont->seq) {
+        return 0;
+    }
+    
+    if(since > cont->seq) {
+        return -1;              // from before a restart of ours; the sequence started over
+    }
+    
+    if(cont->seq - since > CONTAINER_JOURNAL_SIZE) {
+        return -1;              // wrapped
+    }
+    
+    for(seq = since + 1; seq - since <= cont->seq - since; seq++) {
+        Characteristic* c = cont->journal[seq % CONTAINER_JOURNAL_SIZE];
+        
+        // a characteristic changed more than once is only reported at its last change
+        if(c != 0 && c->seq == seq) {
+            refs[count].Aid = c->parent->parent->ID;
+            refs[count].C   = c;
+            count++;
+        }
+    }
+    
+    return count;
+}
+/**
+ * 
+ * @param cont
+ * @param c
+ */
+void ICACHE_FLASH_ATTR containerJournal(Container* cont, Characteristic* c)
+{
+    cont->seq++;
+    
+    c->seq = cont->seq;
+    cont->journal[cont->seq % CONTAINER_JOURNAL_SIZE] = c;
+}
+/**
+ * 
+ * @param cont
+ * @param msg
+ * @param len
+ * @param refs
+ * @param max
+ * @return 
+ */
+int ICACHE_FLASH_ATTR UnmarshalIds(Container* cont, char* msg, int len, CharacteristicRef* refs, int max)
+{
+    JSON_SCAN s;
+    int       count = 0;
+    
+    if(cont == 0 || msg == 0 || refs == 0) {
+        DTXT("UnmarshalIds(): 'cont', 'msg' or 'refs' is nil\n");
+        return -1;
+    }
+    
+    if(scanBegin(&s, msg, len) != 0 || scanObject(&s) != 0 || unmarshalIdsMembers(&s, cont, refs, max, &count, 1) != 0) {
+        DTXT("UnmarshalIds(): malformed message\n");
+        return -1;
+    }
+    
+    return count;
+}
+/**
+ * 
+ * @param format
+ * @param value
+ * @param decimals
+ * @return 
+ */
+char* ICACHE_FLASH_ATTR MarshalBareValue(CharacteristicFormat format, CharacteristicValue* value, int decimals)
+{
+    char* b;
+    int   size = 32;
+    
+    if(value == 0 || format == FormatNone) {
+        return 0;
+    }
+    
+    if(format == FormatString) {
+        size += os_strlen(value->String) * 6;   // worst case; every character escaped as \uXXXX
+    }
+    
+    b = (char*) os_malloc(size);
+    if(b == 0) {
+        DTXT("MarshalBareValue(malloc): mem fail");
+        return 0;
+    }
+    
+    if(MarshalBareValueInto(b, size, format, value, decimals) < 0) {
+        os_free(b);
+        return 0;
+    }
+    
+    return b;
+}
+/**
+ * 
+ * @param buf
+ * @param size
+ * @param format
+ * @param value
+ * @param decimals
+ * @return 
+ */
+int ICACHE_FLASH_ATTR MarshalBareValueInto(char* buf, int size, CharacteristicFormat format, CharacteristicValue* value, int decimals)
+{
+    JEncoder o;
+    JErr     err;
+    BufPrint out;
+    
+    if(value == 0 || format == FormatNone || size < 2) {
+        return -1;
+    }
+    
+    BufPrint_constructor(&out, NULL, _BufPrint_full);
+    BufPrint_setBuf(&out, buf, size - 1);   // room for the zero-termination
+    
+    JErr_constructor(&err);
+    
+    JEncoder_constructor(&o, &err, &out);
+
+    // the encoder wants a container; the brackets are dropped below
+    JEncoder_beginArray(&o);
+    
+    marshalValueItem(&o, format, value, decimals);
+    
+    JEncoder_endArray(&o);
+    
+    if(JErr_isError(&err)) {
+        DTXT("MarshalBareValueInto(): fail; err = %s\n", JErr_getErrS(&err));
+        return -1;
+    }
+    
+    JEncoder_commit(&o);        // this will activate _BufPrint_full()
+    
+    if(JErr_isError(&err)) {
+        return -1;
+    }
+    
+    int len = os_strlen(buf);
+    
+    os_memmove(buf, buf + 1, len - 2);
+    buf[len - 2] = '\0';
+    
+    return len - 2;
+}
+/**
+ * 
+ * @param msg
+ * @param len
+ * @param format
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR UnmarshalBareValue(char* msg, int len, CharacteristicFormat format, CharacteristicValue* value)
+{
+    JSON_SCAN s;
+    JSON_ITEM item;
+    
+    if(msg == 0 || value == 0) {
+        DTXT("UnmarshalBareValue(): 'msg' or 'value' is nil\n");
+        return -1;
+    }
+    
+    if(scanBegin(&s, msg, len) != 0 || scanValue(&s, &item) != 0) {
+        DTXT("UnmarshalBareValue(): malformed message\n");
+        return -1;
+    }
+    
+    return unmarshalValue_private(&item, format, value);
+}
+/**
+ * 
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @param len
+ * @return 
+ */
+uint8_t* ICACHE_FLASH_ATTR MarshalValueCbor(sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int* len)
+{
+    int size = CBOR_VALUE_SIZE;
+    
+    if(format == FormatString && value != 0) {
+        size += os_strlen(value->String);
+    }
+    
+    uint8_t* b = (uint8_t*) os_malloc(size);
+    if(b == 0) {
+        DTXT("MarshalValueCbor(malloc): mem fail");
+        return 0;
+    }
+    
+    if((*len = MarshalValueCborInto(b, size, aid, iid, format, value)) < 0) {
+        os_free(b);
+        return 0;
+    }
+    
+    return b;
+}
+/**
+ * 
+ * @param buf
+ * @param size
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR MarshalValueCborInto(uint8_t* buf, int size, sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value)
+{
+    CBOR_WRITER w;
+    
+    cborWriterBegin(&w, buf, size);
+    
+    cborMap(&w, (value != 0) ? 3 : 2);
+    
+    cborText(&w, "aid");    cborInt(&w, aid);
+    cborText(&w, "iid");    cborInt(&w, iid);
+    
+    if(value != 0) {
+        cborText(&w, "value");
+        cborValueItem(&w, format, value);
+    }
+    
+    return cborWriterEnd(&w);
+}
+/**
+ * 
+ * @param cont
+ * @param refs
+ * @param count
+ * @param len
+ * @return 
+ */
+uint8_t* ICACHE_FLASH_ATTR MarshalValuesCbor(Container* cont, CharacteristicRef* refs, int count, int* len)
+{
+    CBOR_WRITER w;
+    char        txt[CHARACTERISTIC_FORMAT_SIZE];
+    
+    uint8_t* b = (uint8_t*) os_malloc(cont->marshalBufferSize);
+    if(b == 0) {
+        DTXT("MarshalValuesCbor(malloc): mem fail");
+        return 0;
+    }
+    
+    cborWriterBegin(&w, b, cont->marshalBufferSize);
+    
+    cborMap(&w, 3);
+    
+    cborText(&w, "_type");  cborText(&w, "values");
+    cborText(&w, "seq");    cborUInt(&w, cont->seq);
+    
+    cborText(&w, "values");
+    cborArray(&w, count);
+    
+    for(int i = 0; i < count; i++) {
+        Characteristic* c = refs[i].C;
+        
+        cborMap(&w, 2 + (characteristicFormatTxt(c->Format) != 0) + (c->Value != 0));
+        
+        cborText(&w, "aid");    cborInt(&w, refs[i].Aid);
+        cborText(&w, "iid");    cborInt(&w, c->ID);
+        
+        if(characteristicFormatTxt(c->Format) != 0) {
+            cborText(&w, "format");
+            cborText(&w, flashStrcpy(txt, characteristicFormatTxt(c->Format), sizeof(txt)));
+        }
+        
+        if(c->Value != 0) {
+            cborText(&w, "value");
+            cborValueItem(&w, c->Format, c->Value);
+        }
+    }
+    
+    if((*len = cborWriterEnd(&w)) < 0) {
+        DTXT("MarshalValuesCbor(): buffer too small\n");
+        os_free(b);
+        return 0;
+    }
+    
+    return b;
+}
+/**
+ * 
+ * @param msg
+ * @param len
+ * @param format
+ * @param v
+ * @return 
+ */
+int ICACHE_FLASH_ATTR UnmarshalValueCbor(uint8_t* msg, int len, CharacteristicFormat format, ValueMessage* v)
+{
+    CBOR_READER r;
+    CBOR_ITEM   item;
+    CBOR_ITEM   value;
+    
+    if(msg == 0 || v == 0) {
+        DTXT("UnmarshalValueCbor(): 'msg' or 'v' is nil\n");
+        return -1;
+    }
+    
+    v->Type   = 0;
+    v->Aid    = -1;
+    v->Iid    = -1;
+    v->Format = FormatNone;
+    
+    value.kind = CborNone;
+    
+    if(cborReaderBegin(&r, msg, len) != 0 || cborNext(&r, &item) != 0 || item.kind != CborMap || cborValueMembers(&r, item.len, v, &value) != 0) {
+        DTXT("UnmarshalValueCbor(): malformed message\n");
+        return -1;
+    }
+    
+    if(v->Aid < 0 || v->Iid < 0 || value.kind == CborNone) {
+        DTXT("UnmarshalValueCbor(): 'aid', 'iid' or 'value' not found\n");
+        return -1;
+    }
+    
+    v->Format = (format != FormatNone) ? format : characteristicFormatByTxt(v->Type);
+    
+    if(v->Format == FormatNone) {
+        DTXT("UnmarshalValueCbor(): unknown format\n");
+        return -1;
+    }
+    
+    return cborValue_private(&value, v->Format, &v->Value);
+}
+/**
+ * 
+ * @param cont
+ * @param msg
+ * @param len
+ * @param onValue
+ * @param ptr
+ * @return 
+ */
+int ICACHE_FLASH_ATTR UnmarshalValuesCbor(Container* cont, uint8_t* msg, int len, OnValueMessage onValue, void* ptr)
+{
+    CBOR_READER  r;
+    CBOR_ITEM    map;
+    CBOR_ITEM    name;
+    CBOR_ITEM    item;
+    CBOR_ITEM    value;
+    ValueMessage v;
+    int          count = 0;
+    
+    if(cont == 0 || msg == 0 || onValue == 0) {
+        DTXT("UnmarshalValuesCbor(): 'cont', 'msg' or 'onValue' is nil\n");
+        return -1;
+    }
+    
+    if(cborReaderBegin(&r, msg, len) != 0 || cborNext(&r, &map) != 0 || map.kind != CborMap) {
+        goto defer;
+    }
+    
+    for(int i = 0; i < map.len; i++) {
+        if(cborNext(&r, &name) != 0 || cborNext(&r, &item) != 0) {
+            goto defer;
+        }
+        
+        if(!cborTextIs(&name, "values") || item.kind != CborArray) {
+            if(cborSkip(&r, &item) != 0) {
+                goto defer;
+            }
+            
+            continue;
+        }
+        
+        int elements = item.len;
+        
+        while(elements-- > 0) {
+            if(cborNext(&r, &item) != 0 || item.kind != CborMap) {
+                goto defer;
+            }
+            
+            v.Type     = 0;
+            v.Aid      = -1;
+            v.Iid      = -1;
+            v.Format   = FormatNone;
+            value.kind = CborNone;
+            
+            if(cborValueMembers(&r, item.len, &v, &value) != 0) {
+                goto defer;
+            }
+            
+            if(v.Aid < 0 || v.Iid < 0 || value.kind == CborNone) {
+                DTXT("UnmarshalValuesCbor(): 'aid', 'iid' or 'value' not found\n");
+                continue;
+            }
+            
+            v.Format = characteristicFormatByTxt(v.Type);
+            
+            if(v.Format == FormatNone) {
+                Characteristic* c = FindCharacteristicByIid(FindByAid(cont, v.Aid), v.Iid);
+                
+                if(c == 0) {
+                    DTXT("UnmarshalValuesCbor(): aid = %d, iid = %d not found\n", (int) v.Aid, (int) v.Iid);
+                    continue;
+                }
+                
+                v.Format = c->Format;
+            }
+            
+            if(cborValue_private(&value, v.Format, &v.Value) != 0) {
+                DTXT("UnmarshalValuesCbor(): aid = %d, iid = %d invalid value\n", (int) v.Aid, (int) v.Iid);
+                continue;
+            }
+            
+            onValue(&v, ptr);
+            
+            count++;
+        }
+    }
+    
+    return count;
+    
+defer:
+    DTXT("UnmarshalValuesCbor(): malformed message; %d values decoded\n", count);
+    
+    return -1;
+}
+/**
+ * 
+ * @param cont
+ * @return 
+ */
+char* ICACHE_FLASH_ATTR marshalContainer(Container* cont)
+{
+    JEncoder o;
+    JErr     err;
+    BufPrint out;
+    char*    b;
+    
+    b = (char*) os_malloc(cont->marshalBufferSize);
+    if(b == 0) {
+        DTXT("MarshalContainer(malloc): mem fail");
+        return 0;
+    }
+    
+    BufPrint_constructor(&out, NULL, _BufPrint_full);
+    BufPrint_setBuf(&out, b, cont->marshalBufferSize - 1);     // room for the zero-termination
+    
+    JErr_constructor(&err);
+    
+    JEncoder_constructor(&o, &err, &out);
+    
+    JEncoder_beginObject(&o);
+    
+    JEncoder_setName(&o, "d");    
+    JEncoder_beginObject(&o);
+    
+    JEncoder_setName(&o, "_type");          JEncoder_setString(&o, "accessories_list");
+    JEncoder_setName(&o, "nodename");       JEncoder_setString(&o, cont->Nodename);
+    JEncoder_setName(&o, "name");           JEncoder_setString(&o, cont->Name);
+    JEncoder_setName(&o, "model");          JEncoder_setString(&o, cont->Model);
+    JEncoder_setName(&o, "serialnumber");   JEncoder_setString(&o, cont->SerialNumber);
+    JEncoder_setName(&o, "manufacturer");   JEncoder_setString(&o, cont->Manufacturer);
+    JEncoder_setName(&o, "seq");            JEncoder_setLong(&o, cont->seq);
+
+    JEncoder_setName(&o, "value");
+    JEncoder_beginObject(&o);
+    
+    JEncoder_setName(&o, "accessories");
+    JEncoder_beginArray(&o);
+    
+    for(Accessory* a = cont->Accessories; a != NULL; a = a->next) {
+        marshalAccessory(&o, a, &verboseProfile);
+    }
+    
+    JEncoder_endArray(&o);      // "accessories"
+    
+    JEncoder_endObject(&o);     // "value"
+    JEncoder_endObject(&o);     // "d"
+    JEncoder_endObject(&o);
+    
+    if(JErr_isError(&err)) {
+        DTXT("MarshalContainer(): fail; err = %s\n", JErr_getErrS(&err));
+        os_free(b);
+        
+        return 0;
+    } else {
+        JEncoder_commit(&o);    // this will activate _BufPrint_full()
+        DTXT("MarshalContainer(): b = %s\n", b);
+        
+        return b;
+    }
+}
+/**
+ * 
+ * @param cont
+ * @param len
+ * @return 
+ */
+uint8_t* ICACHE_FLASH_ATTR marshalContainerCbor(Container* cont, int* len)
+{
+    CBOR_WRITER w;
+    int         count = 0;
+    
+    uint8_t* b = (uint8_t*) os_malloc(cont->marshalBufferSize);
+    if(b == 0) {
+        DTXT("marshalContainerCbor(malloc): mem fail");
+        return 0;
+    }
+    
+    cborWriterBegin(&w, b, cont->marshalBufferSize);
+    
+    cborMap(&w, 8);
+    
+    cborText(&w, "_type");          cborText(&w, "accessories_list");
+    cborText(&w, "nodename");       cborText(&w, cont->Nodename);
+    cborText(&w, "name");           cborText(&w, cont->Name);
+    cborText(&w, "model");          cborText(&w, cont->Model);
+    cborText(&w, "serialnumber");   cborText(&w, cont->SerialNumber);
+    cborText(&w, "manufacturer");   cborText(&w, cont->Manufacturer);
+    cborText(&w, "seq");            cborUInt(&w, cont->seq);
+    
+    cborText(&w, "value");
+    cborMap(&w, 1);
+    
+    for(Accessory* a = cont->Accessories; a != NULL; a = a->next) {
+        count++;
+    }
+    
+    cborText(&w, "accessories");
+    cborArray(&w, count);
+    
+    for(Accessory* a = cont->Accessories; a != NULL; a = a->next) {
+        cborAccessory(&w, a);
+    }
+    
+    if((*len = cborWriterEnd(&w)) < 0) {
+        DTXT("marshalContainerCbor(): buffer too small\n");
+        os_free(b);
+        return 0;
+    }
+    
+    DTXT("marshalContainerCbor(): len = %d\n", *len);
+    
+    return b;
+}
+/**
+ * 
+ * @param cont
+ * @return 
+ */
+char* ICACHE_FLASH_ATTR marshalContainerCompact(Container* cont)
+{
+    JEncoder o;
+    JErr     err;
+    BufPrint out;
+    char*    b;
+    
+    b = (char*) os_malloc(cont->marshalBufferSize);
+    if(b == 0) {
+        DTXT("marshalContainerCompact(malloc): mem fail");
+        return 0;
+    }
+    
+    BufPrint_constructor(&out, NULL, _BufPrint_full);
+    BufPrint_setBuf(&out, b, cont->marshalBufferSize - 1);     // room for the zero-termination
+    
+    JErr_constructor(&err);
+    
+    JEncoder_constructor(&o, &err, &out);
+    
+    JEncoder_beginObject(&o);
+    
+    JEncoder_setName(&o, "n");      JEncoder_setString(&o, cont->Nodename);
+    JEncoder_setName(&o, "N");      JEncoder_setString(&o, cont->Name);
+    JEncoder_setName(&o, "M");      JEncoder_setString(&o, cont->Model);
+    JEncoder_setName(&o, "S");      JEncoder_setString(&o, cont->SerialNumber);
+    JEncoder_setName(&o, "F");      JEncoder_setString(&o, cont->Manufacturer);
+    JEncoder_setName(&o, "q");      JEncoder_setLong(&o, cont->seq);
+
+    JEncoder_setName(&o, "a");
+    JEncoder_beginArray(&o);
+    
+    for(Accessory* a = cont->Accessories; a != NULL; a = a->next) {
+        marshalAccessory(&o, a, &compactProfile);
+    }
+    
+    JEncoder_endArray(&o);      // "a"
+    JEncoder_endObject(&o);
+    
+    if(JErr_isError(&err)) {
+        DTXT("marshalContainerCompact(): fail; err = %s\n", JErr_getErrS(&err));
+        os_free(b);
+        
+        return 0;
+    } else {
+        JEncoder_commit(&o);    // this will activate _BufPrint_full()
+        
+        return b;
+    }
+}
+/**
+ * 
+ * @param o
+ * @param a
+ * @param p
+ * @return 
+ */
+int ICACHE_FLASH_ATTR marshalAccessory(JEncoder* o, Accessory* a, const MarshalProfile* p)
+{
+    JEncoder_beginObject(o);
+    JEncoder_setName(o, p->aid);  JEncoder_setLong(o, a->ID);
+    JEncoder_setName(o, p->type); JEncoder_setInt(o, a->Type);
+
+    JEncoder_setName(o, p->services);
+    JEncoder_beginArray(o);
+
+    for(Service* svc = a->Service; svc != NULL; svc = svc->next) {
+        marshalService(o, svc, p);
+    }
+
+    JEncoder_endArray(o);   // "services"
+    JEncoder_endObject(o);
+
+    return 0;
+}
+/**
+ * 
+ * @param o
+ * @param s
+ * @param p
+ * @return 
+ */
+int ICACHE_FLASH_ATTR marshalService(JEncoder* o, Service* s, const MarshalProfile* p)
+{
+    char txt[TYPE_TXT_SIZE];
+    
+    JEncoder_beginObject(o);
+    JEncoder_setName(o, p->iid);  JEncoder_setLong(o, s->ID);
+    JEncoder_setName(o, p->type); JEncoder_setString(o, flashStrcpy(txt, s->Type, sizeof(txt)));
+
+    JEncoder_setName(o, p->characteristics);
+    JEncoder_beginArray(o);
+
+    for(Characteristic* ch = s->Characteristics; ch != NULL; ch = ch->next) {
+        marshalCharacteristic(o, ch, p);
+    }
+
+    JEncoder_endArray(o);       // "characteristics"
+    JEncoder_endObject(o);
+
+    return 0;
+}
+/**
+ * 
+ * @param o
+ * @param c
+ * @param p
+ * @return 
+ */
+int ICACHE_FLASH_ATTR marshalCharacteristic(JEncoder* o, Characteristic* c, const MarshalProfile* p)
+{
+    char txt[TYPE_TXT_SIZE];
+    
+    JEncoder_beginObject(o);
+    JEncoder_setName(o, p->iid);  JEncoder_setLong(o, c->ID);
+    JEncoder_setName(o, p->type); JEncoder_setString(o, flashStrcpy(txt, c->Type, sizeof(txt)));
+
+    // perms
+    JEncoder_setName(o, p->perms);
+    
+    if(p->compact) {
+        JEncoder_setInt(o, c->Perms & (PermRead | PermWrite | PermEvents));
+    } else {
+        JEncoder_beginArray(o);
+
+        if((c->Perms & PermRead) == PermRead) {
+            JEncoder_setString(o, "pr");
+        }
+        if((c->Perms & PermWrite) == PermWrite) {
+            JEncoder_setString(o, "pw");
+        }
+        if((c->Perms & PermEvents) == PermEvents) {
+            JEncoder_setString(o, "ev");
+        }
+
+        JEncoder_endArray(o);   // "perms"
+    }
+
+    // value - optional
+    characteristicRefresh(c);
+    marshalValue_private(o, p->value, c->Format, c->Value, characteristicDecimals(c));
+
+    // format
+    if(characteristicFormatTxt(c->Format) != 0) {
+        JEncoder_setName(o, p->format);
+        
+        if(p->compact) {
+            JEncoder_setInt(o, c->Format);
+        } else {
+            JEncoder_setString(o, flashStrcpy(txt, characteristicFormatTxt(c->Format), sizeof(txt)));
+        }
+    }
+    
+    // unit - optional
+    if(c->Unit != NULL) {
+        JEncoder_setName(o, p->unit);
+        JEncoder_setString(o, flashStrcpy(txt, c->Unit, sizeof(txt)));
+    }
+    
+    // maxValue - optional
+    marshalValue_private(o, p->maxValue, c->Format, c->MaxValue, NUMBER_DECIMALS_DEFAULT);
+    
+    // minValue - optional
+    marshalValue_private(o, p->minValue, c->Format, c->MinValue, NUMBER_DECIMALS_DEFAULT);
+    
+    // minStep - optional
+    marshalValue_private(o, p->minStep, c->Format, c->StepValue, NUMBER_DECIMALS_DEFAULT);
+    
+    JEncoder_endObject(o);
+
+    return 0;
+}
+/**
+ * 
+ * @param o
+ * @param name
+ * @param format
+ * @param value
+ * @param decimals
+ * @return 
+ */
+int ICACHE_FLASH_ATTR marshalValue_private(JEncoder* o, const char* name, CharacteristicFormat format, CharacteristicValue* value, int decimals)
+{
+    if(value != NULL) {
+        JEncoder_setName(o, name);
+        
+        marshalValueItem(o, format, value, decimals);
+    }
+
+    return 0;
+}
+/**
+ * 
+ * @param o
+ * @param format
+ * @param value
+ * @param decimals
+ * @return 
+ */
+int ICACHE_FLASH_ATTR marshalValueItem(JEncoder* o, CharacteristicFormat format, CharacteristicValue* value, int decimals)
+{
+    char num[NUMBER_FORMAT_SIZE];
+    
+    // numbers are formatted here and handed to the encoder as is
+    switch(format) {
+        case FormatString:  
+            JEncoder_setString(o, value->String);    
+            break;
+        case FormatBool:    
+            JEncoder_setBoolean(o, value->Bool);     
             break;
         case FormatUInt8:   
-            JEncoder_setString(o, FormatUInt8Txt);    
+            numberFormatUInt(num, value->UInt8);
+            JEncoder_fmtNumber(o, "%s", num);
             break;
         case FormatInt8:    
-            JEncoder_setString(o, FormatInt8Txt);    
+            numberFormatInt(num, value->Int8);
+            JEncoder_fmtNumber(o, "%s", num);
             break;
         case FormatUInt16:  
-            JEncoder_setString(o, FormatUInt16Txt);    
+            numberFormatUInt(num, value->UInt16);
+            JEncoder_fmtNumber(o, "%s", num);
             break;
         case FormatInt16:   
-            JEncoder_setString(o, FormatInt16Txt);    
+            numberFormatInt(num, value->Int16);
+            JEncoder_fmtNumber(o, "%s", num);
             break;
         case FormatUInt32:  
-            JEncoder_setString(o, FormatUInt32Txt);    
+            numberFormatUInt(num, value->UInt32);
+            JEncoder_fmtNumber(o, "%s", num);
             break;
         case FormatInt32:   
-            JEncoder_setString(o, FormatInt32Txt);    
+            numberFormatInt(num, value->Int32);
+            JEncoder_fmtNumber(o, "%s", num);
             break;
         case FormatUInt64:  
-            JEncoder_setString(o, FormatUInt64Txt);    
+            numberFormatUInt(num, value->UInt64);
+            JEncoder_fmtNumber(o, "%s", num);
+            break;
+        case FormatFloat:   
+            if(numberFormatFixed(num, value->Float, decimals) < 0) {
+                JEncoder_setDouble(o, value->Float);    // out of fixed-point range
+            } else {
+                JEncoder_fmtNumber(o, "%s", num);
+            }
+            break;
+        case FormatNone:
+            break;
+    }        
+
+    return 0;
+}
+/**
+ * Collects the members of a value message; the value itself is kept as an item since its format may only be known
+ * once "_type" has been seen
+ * @param s
+ * @param v
+ * @param value
+ * @param envelope 1 if a "d" envelope may follow, it is accepted once
+ * @return 
+ */
+int ICACHE_FLASH_ATTR unmarshalValueMembers(JSON_SCAN* s, ValueMessage* v, JSON_ITEM* value, int envelope)
+{
+    const char* name;
+    JSON_ITEM   item;
+    int         ret;
+    
+    while((ret = scanMember(s, &name, &item)) == 0) {
+        if(os_strcmp(name, "d") == 0 && item.kind == JsonObject) {
+            if(!envelope || scanObject(s) != 0 || unmarshalValueMembers(s, v, value, 0) != 0) {
+                return -1;
+            }
+            
+            continue;
+        } else if(os_strcmp(name, "_type") == 0 || os_strcmp(name, "format") == 0) {
+            v->Type = scanString(&item);
+        } else if(os_strcmp(name, "aid") == 0) {
+            if(scanInt64(&item, &v->Aid) != 0) {
+                return -1;
+            }
+        } else if(os_strcmp(name, "iid") == 0) {
+            if(scanInt64(&item, &v->Iid) != 0) {
+                return -1;
+            }
+        } else if(os_strcmp(name, "value") == 0) {
+            *value = item;
+        }
+        
+        if(scanSkip(s, &item) != 0) {
+            return -1;
+        }
+    }
+    
+    return (ret == 1) ? 0 : -1;
+}
+/**
+ * 
+ * @param s
+ * @param cont
+ * @param onValue
+ * @param ptr
+ * @param count
+ * @param envelope 1 if a "d" envelope may follow, it is accepted once
+ * @return 
+ */
+int ICACHE_FLASH_ATTR unmarshalValuesMembers(JSON_SCAN* s, Container* cont, OnValueMessage onValue, void* ptr, int* count, int envelope)
+{
+    const char*  name;
+    JSON_ITEM    item;
+    JSON_ITEM    value;
+    ValueMessage v;
+    int          ret;
+    
+    while((ret = scanMember(s, &name, &item)) == 0) {
+        if(os_strcmp(name, "d") == 0 && item.kind == JsonObject) {
+            if(!envelope || scanObject(s) != 0 || unmarshalValuesMembers(s, cont, onValue, ptr, count, 0) != 0) {
+                return -1;
+            }
+            
+            continue;
+        }
+        
+        if(os_strcmp(name, "values") != 0 || item.kind != JsonArray) {
+            if(scanSkip(s, &item) != 0) {
+                return -1;
+            }
+            
+            continue;
+        }
+        
+        if(scanArray(s) != 0) {
+            return -1;
+        }
+        
+        while((ret = scanElement(s, &item)) == 0) {
+            if(item.kind != JsonObject) {
+                return -1;
+            }
+            
+            v.Type     = 0;
+            v.Aid      = -1;
+            v.Iid      = -1;
+            v.Format   = FormatNone;
+            value.kind = JsonNone;
+            
+            if(scanObject(s) != 0 || unmarshalValueMembers(s, &v, &value, 0) != 0) {
+                return -1;
+            }
+            
+            if(v.Aid < 0 || v.Iid < 0 || value.kind == JsonNone) {
+                DTXT("unmarshalValuesMembers(): 'aid', 'iid' or 'value' not found\n");
+                continue;
+            }
+            
+            v.Format = characteristicFormatByTxt(v.Type);
+            
+            if(v.Format == FormatNone) {
+                Characteristic* c = FindCharacteristicByIid(FindByAid(cont, v.Aid), v.Iid);
+                
+                if(c == 0) {
+                    DTXT("unmarshalValuesMembers(): aid = %d, iid = %d not found\n", (int) v.Aid, (int) v.Iid);
+                    continue;
+                }
+                
+                v.Format = c->Format;
+            }
+            
+            if(unmarshalValue_private(&value, v.Format, &v.Value) != 0) {
+                DTXT("unmarshalValuesMembers(): aid = %d, iid = %d invalid value\n", (int) v.Aid, (int) v.Iid);
+                continue;
+            }
+            
+            onValue(&v, ptr);
+            
+            (*count)++;
+        }
+        
+        if(ret != 1) {
+            return -1;
+        }
+    }
+    
+    return (ret == 1) ? 0 : -1;
+}
+/**
+ * 
+ * @param s
+ * @param cont
+ * @param refs
+ * @param max
+ * @param count
+ * @param envelope 1 if a "d" envelope may follow, it is accepted once
+ * @return 
+ */
+int ICACHE_FLASH_ATTR unmarshalIdsMembers(JSON_SCAN* s, Container* cont, CharacteristicRef* refs, int max, int* count, int envelope)
+{
+    const char*  name;
+    JSON_ITEM    item;
+    JSON_ITEM    value;
+    ValueMessage v;
+    int          ret;
+    
+    while((ret = scanMember(s, &name, &item)) == 0) {
+        if(os_strcmp(name, "d") == 0 && item.kind == JsonObject) {
+            if(!envelope || scanObject(s) != 0 || unmarshalIdsMembers(s, cont, refs, max, count, 0) != 0) {
+                return -1;
+            }
+            
+            continue;
+        }
+        
+        if(os_strcmp(name, "ids") != 0 || item.kind != JsonArray) {
+            if(scanSkip(s, &item) != 0) {
+                return -1;
+            }
+            
+            continue;
+        }
+        
+        if(scanArray(s) != 0) {
+            return -1;
+        }
+        
+        while((ret = scanElement(s, &item)) == 0) {
+            if(item.kind != JsonObject) {
+                return -1;
+            }
+            
+            v.Aid      = -1;
+            v.Iid      = -1;
+            value.kind = JsonNone;
+            
+            if(scanObject(s) != 0 || unmarshalValueMembers(s, &v, &value, 0) != 0) {
+                return -1;
+            }
+            
+            Accessory*      a = FindByAid(cont, v.Aid);
+            Characteristic* c = (a != 0) ? FindCharacteristicByIid(a, v.Iid) : 0;
+            
+            if(c == 0) {
+                DTXT("unmarshalIdsMembers(): aid = %d, iid = %d not found\n", (int) v.Aid, (int) v.Iid);
+            } else if(*count == max) {
+                DTXT("unmarshalIdsMembers(): too many ids; aid = %d, iid = %d ignored\n", (int) v.Aid, (int) v.Iid);
+            } else {
+                refs[*count].Aid = v.Aid;
+                refs[*count].C   = c;
+                (*count)++;
+            }
+        }
+        
+        if(ret != 1) {
+            return -1;
+        }
+    }
+    
+    return (ret == 1) ? 0 : -1;
+}
+/**
+ * 
+ * @param s
+ * @param seq
+ * @param envelope 1 if a "d" envelope may follow, it is accepted once
+ * @return 
+ */
+int ICACHE_FLASH_ATTR unmarshalSeqMembers(JSON_SCAN* s, sint64_t* seq, int envelope)
+{
+    const char* name;
+    JSON_ITEM   item;
+    int         ret;
+    
+    while((ret = scanMember(s, &name, &item)) == 0) {
+        if(os_strcmp(name, "d") == 0 && item.kind == JsonObject) {
+            if(!envelope || scanObject(s) != 0 || unmarshalSeqMembers(s, seq, 0) != 0) {
+                return -1;
+            }
+            
+            continue;
+        }
+        
+        if(os_strcmp(name, "seq") == 0 && scanInt64(&item, seq) != 0) {
+            return -1;
+        }
+        
+        if(scanSkip(s, &item) != 0) {
+            return -1;
+        }
+    }
+    
+    return (ret == 1) ? 0 : -1;
+}
+/**
+ * 
+ * @param item
+ * @param format
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR unmarshalValue_private(JSON_ITEM* item, CharacteristicFormat format, CharacteristicValue* value)
+{
+    sint64_t i;
+    uint64_t u;
+    
+    switch(format) {
+        case FormatString:
+            value->String = (char*) scanString(item);
+            return (value->String != 0) ? 0 : -1;
+            
+        case FormatBool:
+            return scanBool(item, &value->Bool);
+            
+        case FormatFloat:
+            return scanDouble(item, &value->Float);
+            
+        case FormatUInt8:
+        case FormatUInt16:
+        case FormatUInt32:
+        case FormatUInt64:
+            if(scanUInt64(item, &u) != 0) {
+                return -1;
+            }
+            
+            return valueFromUInt64(format, u, value);
+            
+        case FormatInt8:
+        case FormatInt16:
+        case FormatInt32:
+            if(scanInt64(item, &i) != 0) {
+                return -1;
+            }
+            
+            return valueFromInt64(format, i, value);
+            
+        case FormatNone:
             break;
-        case FormatFloat:   
-            JEncoder_setString(o, FormatFloatTxt);    
+    }
+    
+    return -1;
+}
+/**
+ * Narrows 'u' to the unsigned 'format'; a value that doesn't fit is an error rather than being truncated
+ * @param format
+ * @param u
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR valueFromUInt64(CharacteristicFormat format, uint64_t u, CharacteristicValue* value)
+{
+    switch(format) {
+        case FormatUInt8:
+            if(u > 0xFF) {
+                return -1;
+            }
+            value->UInt8 = (uint8_t) u;
+            return 0;
+            
+        case FormatUInt16:
+            if(u > 0xFFFF) {
+                return -1;
+            }
+            value->UInt16 = (uint16_t) u;
+            return 0;
+            
+        case FormatUInt32:
+            if(u > 0xFFFFFFFFULL) {
+                return -1;
+            }
+            value->UInt32 = (uint32_t) u;
+            return 0;
+            
+        case FormatUInt64:
+            value->UInt64 = u;
+            return 0;
+            
+        default:
             break;
-        case FormatNone:
+    }
+    
+    return -1;
+}
+/**
+ * Narrows 'i' to the signed 'format'; a value that doesn't fit is an error rather than being truncated
+ * @param format
+ * @param i
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR valueFromInt64(CharacteristicFormat format, sint64_t i, CharacteristicValue* value)
+{
+    switch(format) {
+        case FormatInt8:
+            if(i < -128 || i > 127) {
+                return -1;
+            }
+            value->Int8 = (int8_t) i;
+            return 0;
+            
+        case FormatInt16:
+            if(i < -32768 || i > 32767) {
+                return -1;
+            }
+            value->Int16 = (int16_t) i;
+            return 0;
+            
+        case FormatInt32:
+            if(i < -2147483647LL - 1 || i > 2147483647LL) {
+                return -1;
+            }
+            value->Int32 = (int32_t) i;
+            return 0;
+            
+        default:
             break;
     }
     
-    // unit - optional
-    if(c->Unit != NULL) {
-        JEncoder_setName(o, "unit");
-        JEncoder_setString(o, c->Unit);
+    return -1;
+}
+/**
+ * 
+ * @param w
+ * @param format
+ * @param value
+ */
+void ICACHE_FLASH_ATTR cborValueItem(CBOR_WRITER* w, CharacteristicFormat format, CharacteristicValue* value)
+{
+    switch(format) {
+        case FormatString:  cborText(w, value->String);     break;
+        case FormatBool:    cborBool(w, value->Bool);       break;
+        case FormatUInt8:   cborUInt(w, value->UInt8);      break;
+        case FormatInt8:    cborInt(w, value->Int8);        break;
+        case FormatUInt16:  cborUInt(w, value->UInt16);     break;
+        case FormatInt16:   cborInt(w, value->Int16);       break;
+        case FormatUInt32:  cborUInt(w, value->UInt32);     break;
+        case FormatInt32:   cborInt(w, value->Int32);       break;
+        case FormatUInt64:  cborUInt(w, value->UInt64);     break;
+        case FormatFloat:   cborFloat(w, value->Float);     break;
+        case FormatNone:    cborNull(w);                    break;
     }
+}
+/**
+ * 
+ * @param w
+ * @param a
+ */
+void ICACHE_FLASH_ATTR cborAccessory(CBOR_WRITER* w, Accessory* a)
+{
+    char txt[TYPE_TXT_SIZE];
+    int  count = 0;
     
-    // maxValue - optional
-    marshalValue_private(o, "maxValue", c->Format, c->MaxValue);
+    cborMap(w, 3);
+    cborText(w, "aid");     cborInt(w, a->ID);
+    cborText(w, "type");    cborInt(w, a->Type);
     
-    // minValue - optional
-    marshalValue_private(o, "minValue", c->Format, c->MinValue);
+    for(Service* svc = a->Service; svc != NULL; svc = svc->next) {
+        count++;
+    }
     
-    // minStep - optional
-    marshalValue_private(o, "minStep", c->Format, c->StepValue);
+    cborText(w, "services");
+    cborArray(w, count);
     
-    JEncoder_endObject(o);
-
-    return 0;
+    for(Service* svc = a->Service; svc != NULL; svc = svc->next) {
+        count = 0;
+        
+        for(Characteristic* ch = svc->Characteristics; ch != NULL; ch = ch->next) {
+            count++;
+        }
+        
+        cborMap(w, 3);
+        cborText(w, "iid");     cborInt(w, svc->ID);
+        cborText(w, "type");    cborText(w, flashStrcpy(txt, svc->Type, sizeof(txt)));
+        
+        cborText(w, "characteristics");
+        cborArray(w, count);
+        
+        for(Characteristic* ch = svc->Characteristics; ch != NULL; ch = ch->next) {
+            cborCharacteristic(w, ch);
+        }
+    }
 }
 /**
  * 
- * @param o
- * @param name
- * @param format
+ * @param w
+ * @param c
+ */
+void ICACHE_FLASH_ATTR cborCharacteristic(CBOR_WRITER* w, Characteristic* c)
+{
+    char txt[TYPE_TXT_SIZE];
+    
+    characteristicRefresh(c);
+    
+    int perms = ((c->Perms & PermRead) == PermRead) + ((c->Perms & PermWrite) == PermWrite) + ((c->Perms & PermEvents) == PermEvents);
+    
+    cborMap(w, 3 + (c->Value != NULL) + (characteristicFormatTxt(c->Format) != 0) + (c->Unit != NULL) + 
+               (c->MaxValue != NULL) + (c->MinValue != NULL) + (c->StepValue != NULL));
+    
+    cborText(w, "iid");     cborInt(w, c->ID);
+    cborText(w, "type");    cborText(w, flashStrcpy(txt, c->Type, sizeof(txt)));
+    
+    cborText(w, "perms");
+    cborArray(w, perms);
+    
+    if((c->Perms & PermRead) == PermRead) {
+        cborText(w, "pr");
+    }
+    if((c->Perms & PermWrite) == PermWrite) {
+        cborText(w, "pw");
+    }
+    if((c->Perms & PermEvents) == PermEvents) {
+        cborText(w, "ev");
+    }
+    
+    if(c->Value != NULL) {
+        cborText(w, "value");       cborValueItem(w, c->Format, c->Value);
+    }
+    if(characteristicFormatTxt(c->Format) != 0) {
+        cborText(w, "format");      cborText(w, flashStrcpy(txt, characteristicFormatTxt(c->Format), sizeof(txt)));
+    }
+    if(c->Unit != NULL) {
+        cborText(w, "unit");        cborText(w, flashStrcpy(txt, c->Unit, sizeof(txt)));
+    }
+    if(c->MaxValue != NULL) {
+        cborText(w, "maxValue");    cborValueItem(w, c->Format, c->MaxValue);
+    }
+    if(c->MinValue != NULL) {
+        cborText(w, "minValue");    cborValueItem(w, c->Format, c->MinValue);
+    }
+    if(c->StepValue != NULL) {
+        cborText(w, "minStep");     cborValueItem(w, c->Format, c->StepValue);
+    }
+}
+/**
+ * Collects the members of a CBOR value message; the value is kept as an item until the format is known
+ * @param r
+ * @param pairs
+ * @param v
  * @param value
  * @return 
  */
-int ICACHE_FLASH_ATTR marshalValue_private(JEncoder* o, const char* name, CharacteristicFormat format, CharacteristicValue* value)
+int ICACHE_FLASH_ATTR cborValueMembers(CBOR_READER* r, int pairs, ValueMessage* v, CBOR_ITEM* value)
 {
-    if(value != NULL) {
-        JEncoder_setName(o, name);
+    CBOR_ITEM name;
+    CBOR_ITEM item;
+    
+    while(pairs-- > 0) {
+        if(cborNext(r, &name) != 0 || cborNext(r, &item) != 0) {
+            return -1;
+        }
+        
+        if(cborTextIs(&name, "format") || cborTextIs(&name, "_type")) {
+            v->Type = cborString(&item);
+        } else if(cborTextIs(&name, "aid")) {
+            if(cborGetInt64(&item, &v->Aid) != 0) {
+                return -1;
+            }
+        } else if(cborTextIs(&name, "iid")) {
+            if(cborGetInt64(&item, &v->Iid) != 0) {
+                return -1;
+            }
+        } else if(cborTextIs(&name, "value")) {
+            *value = item;
+        }
         
-        switch(format) {
-            case FormatString:  
-                JEncoder_setString(o, value->String);    
-                break;
-            case FormatBool:    
-                JEncoder_setBoolean(o, value->Bool);     
-                break;
-            case FormatUInt8:   
-                JEncoder_setInt(o, value->UInt8);        
-                break;
-            case FormatInt8:    
-                JEncoder_setInt(o, value->Int8);         
-                break;
-            case FormatUInt16:  
-                JEncoder_setInt(o, value->UInt16);       
-                break;
-            case FormatInt16:   
-                JEncoder_setInt(o, value->Int16);        
-                break;
-            case FormatUInt32:  
-                JEncoder_setLong(o, value->UInt32);      
-                break;
-            case FormatInt32:   
-                JEncoder_setLong(o, value->Int32);       
-                break;
-            case FormatUInt64:  
-                JEncoder_setLong(o, value->UInt64);      
-                break;
-            case FormatFloat:   
-                JEncoder_setDouble(o, value->Float);     
-                break;
-            case FormatNone:
-                break;
-        }        
+        if(cborSkip(r, &item) != 0) {
+            return -1;
+        }
     }
-
+    
     return 0;
 }
 /**
- * BufPrint "flush" callback function used indirectly by JEncoder. The function is called when the buffer is full or if committed.
+ * 
+ * @param item
+ * @param format
+ * @param value
+ * @return 
+ */
+int ICACHE_FLASH_ATTR cborValue_private(CBOR_ITEM* item, CharacteristicFormat format, CharacteristicValue* value)
+{
+    sint64_t i;
+    uint64_t u;
+    
+    switch(format) {
+        case FormatString:
+            value->String = (char*) cborString(item);
+            return (value->String != 0) ? 0 : -1;
+            
+        case FormatBool:
+            return cborGetBool(item, &value->Bool);
+            
+        case FormatFloat:
+            return cborGetDouble(item, &value->Float);
+            
+        case FormatUInt8:
+        case FormatUInt16:
+        case FormatUInt32:
+        case FormatUInt64:
+            if(cborGetUInt64(item, &u) != 0) {
+                return -1;
+            }
+            
+            return valueFromUInt64(format, u, value);
+            
+        case FormatInt8:
+        case FormatInt16:
+        case FormatInt32:
+            if(cborGetInt64(item, &i) != 0) {
+                return -1;
+            }
+            
+            return valueFromInt64(format, i, value);
+            
+        case FormatNone:
+            break;
+    }
+    
+    return -1;
+}
+/**
+ * BufPrint "flush" callback function used indirectly by JEncoder. The function is called when the buffer is full or if 
+ * committed; the buffer holds the whole message, so running out of room is an error instead of starting over.
  * 
  * @param o
  * @param sizeRequired
  * @return 
  */
-int ICACHE_FLASH_ATTR _BufPrint_flush(BufPrint* o, int sizeRequired)
+int ICACHE_FLASH_ATTR _BufPrint_full(BufPrint* o, int sizeRequired)
 {
+    if(sizeRequired > 0) {
+        return -1;          // the buffer belongs to the caller and can't be emptied
+    }
+    
     BufPrint_getBuf(o)[o->cursor] = '\0';
     
-    //DTXT("%s\n", BufPrint_getBuf(o));
-
-    BufPrint_erase(o);      // data flushed (just marked erased, data is still in the buffer)
-   
-    return 0;    // ok
+    return 0;
 }
@@ -45,6 +45,11 @@ typedef struct MqttDevice MqttDevice;
  *
  */
 
+// number of changes kept for incremental resync, see ContainerChanges()
+#ifndef CONTAINER_JOURNAL_SIZE
+#define CONTAINER_JOURNAL_SIZE  16
+#endif
+
 typedef struct Container Container;
  
 struct Container {
@@ -59,8 +64,28 @@ struct Container {
     
     int         marshalBufferSize;
     MqttDevice* parent;
+    
+    uint32_t        seq;                                    // sequence number of the last change
+    Characteristic* journal[CONTAINER_JOURNAL_SIZE];        // the characteristic changed at 'seq', indexed by seq
 };
 
+// a decoded value message; a String value points into the message buffer
+typedef struct {
+    const char*             Type;       // "_type"
+    sint64_t                Aid;        // "aid"
+    sint64_t                Iid;        // "iid"
+    CharacteristicFormat    Format;
+    CharacteristicValue     Value;      // "value"
+} ValueMessage;
+
+typedef void (*OnValueMessage)(ValueMessage* v, void* ptr);
+
+// a characteristic together with the id of the accessory it belongs to
+typedef struct {
+    sint64_t                Aid;
+    Characteristic*         C;
+} CharacteristicRef;
+
 /******************************************************************************************************************
  * prototypes
  *
@@ -98,15 +123,198 @@ Accessory* FindByAid(Container* cont, sint64_t aid);
  * @param iid
  * @param format
  * @param value
+ * @param decimals FormatFloat digits after the point, see characteristicDecimals()
  * @return 
  */
-char* MarshalValue(sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value);
+char* MarshalValue(sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int decimals);
+/**
+ * MarshalValueInto is MarshalValue() into a buffer supplied by the caller, e.g. the one of OfframpReserve()
+ * @param buf
+ * @param size
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @param decimals
+ * @return the length of the zero-terminated message or -1 if it didn't fit
+ */
+int MarshalValueInto(char* buf, int size, sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int decimals);
+/**
+ * MarshalValues encodes the current value of several characteristics into a single "values" message
+ * @param cont
+ * @param refs
+ * @param count
+ * @return 
+ */
+char* MarshalValues(Container* cont, CharacteristicRef* refs, int count);
+/**
+ * UnmarshalValue decodes a value message in a single pass, in place and without allocating. The format is taken 
+ * from feedId when it names one, otherwise from "_type". The message may be wrapped in a "d" object.
+ * @param msg
+ * @param len
+ * @param feedId
+ * @param v
+ * @return 
+ */
+int UnmarshalValue(char* msg, int len, const char* feedId, ValueMessage* v);
+/**
+ * UnmarshalValues decodes a "values" message holding several value messages in a "values" array and hands each of 
+ * them to 'onValue' as soon as it has been decoded. An element without "format" (or "_type") takes the format of 
+ * its characteristic in 'cont'
+ * @param cont
+ * @param msg
+ * @param len
+ * @param onValue
+ * @param ptr
+ * @return number of values decoded or -1 on a malformed message
+ */
+int UnmarshalValues(Container* cont, char* msg, int len, OnValueMessage onValue, void* ptr);
+/**
+ * MarshalAccessory encodes the schema of a single accessory
+ * @param cont
+ * @param a
+ * @return 
+ */
+char* MarshalAccessory(Container* cont, Accessory* a);
+/**
+ * MarshalIndex encodes the container information and the ids of its accessories
+ * @param cont
+ * @return 
+ */
+char* MarshalIndex(Container* cont);
+/**
+ * UnmarshalSeq decodes a "resync" message, i.e. its "seq" member
+ * @param msg
+ * @param len
+ * @param seq
+ * @return 
+ */
+int UnmarshalSeq(char* msg, int len, uint32_t* seq);
+/**
+ * ContainerChanges returns the characteristics changed after 'since', each once
+ * @param cont
+ * @param since
+ * @param refs      room for CONTAINER_JOURNAL_SIZE references
+ * @return number of references or -1 if the journal no longer goes back to 'since' or 'since' is ahead of us
+ */
+int ContainerChanges(Container* cont, uint32_t since, CharacteristicRef* refs);
+/**
+ * Stamps a change of 'c' with the next sequence number and records it in the journal
+ * @param cont
+ * @param c
+ */
+void containerJournal(Container* cont, Characteristic* c);
+/**
+ * UnmarshalIds decodes a "read" message - an "ids" array of aid/iid pairs - into references to the characteristics 
+ * in 'cont'. Unknown pairs are skipped, pairs beyond 'max' are ignored
+ * @param cont
+ * @param msg
+ * @param len
+ * @param refs
+ * @param max
+ * @return number of references or -1 on a malformed message
+ */
+int UnmarshalIds(Container* cont, char* msg, int len, CharacteristicRef* refs, int max);
+/**
+ * MarshalBareValue encodes just the value, e.g. 21.5 or "text", for the addressed value feeds
+ * @param format
+ * @param value
+ * @param decimals FormatFloat digits after the point, see characteristicDecimals()
+ * @return 
+ */
+char* MarshalBareValue(CharacteristicFormat format, CharacteristicValue* value, int decimals);
+/**
+ * MarshalBareValueInto is MarshalBareValue() into a buffer supplied by the caller
+ * @param buf
+ * @param size
+ * @param format
+ * @param value
+ * @param decimals
+ * @return the length of the zero-terminated message or -1 if it didn't fit
+ */
+int MarshalBareValueInto(char* buf, int size, CharacteristicFormat format, CharacteristicValue* value, int decimals);
+/**
+ * UnmarshalBareValue is the reverse of MarshalBareValue(); strings are unescaped in place in 'msg'
+ * @param msg
+ * @param len
+ * @param format
+ * @param value
+ * @return 
+ */
+int UnmarshalBareValue(char* msg, int len, CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * MarshalValueCbor is the CBOR version of MarshalValue(); a map of "aid", "iid" and "value", without the "d" wrapper
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @param len       number of bytes in the returned buffer
+ * @return 
+ */
+uint8_t* MarshalValueCbor(sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value, int* len);
+/**
+ * MarshalValueCborInto is MarshalValueCbor() into a buffer supplied by the caller
+ * @param buf
+ * @param size
+ * @param aid
+ * @param iid
+ * @param format
+ * @param value
+ * @return the number of bytes written or -1 if they didn't fit
+ */
+int MarshalValueCborInto(uint8_t* buf, int size, sint64_t aid, sint64_t iid, CharacteristicFormat format, CharacteristicValue* value);
+/**
+ * MarshalValuesCbor is the CBOR version of MarshalValues()
+ * @param cont
+ * @param refs
+ * @param count
+ * @param len
+ * @return 
+ */
+uint8_t* MarshalValuesCbor(Container* cont, CharacteristicRef* refs, int count, int* len);
+/**
+ * UnmarshalValueCbor decodes a CBOR value message, see MarshalValueCbor(); strings are terminated in place in 'msg'
+ * @param msg
+ * @param len
+ * @param format    the format named by the feedId, FormatNone to take it from "format"
+ * @param v
+ * @return 
+ */
+int UnmarshalValueCbor(uint8_t* msg, int len, CharacteristicFormat format, ValueMessage* v);
+/**
+ * UnmarshalValuesCbor is the CBOR version of UnmarshalValues()
+ * @param cont
+ * @param msg
+ * @param len
+ * @param onValue
+ * @param ptr
+ * @return 
+ */
+int UnmarshalValuesCbor(Container* cont, uint8_t* msg, int len, OnValueMessage onValue, void* ptr);
 /**
  * 
  * @param cont
  * @return 
  */
 char* marshalContainer(Container* cont);
+/**
+ * CBOR version of marshalContainer(); same structure, without the "d" wrapper
+ * @param cont
+ * @param len
+ * @return 
+ */
+uint8_t* marshalContainerCbor(Container* cont, int* len);
+/**
+ * Compact JSON version of marshalContainer(); single letter keys, perms as a bitmask of CharacteristicPerms, format 
+ * as a CharacteristicFormat and no "d" wrapper:
+ * {"n":nodename,"N":name,"M":model,"S":serialnumber,"F":manufacturer,"q":seq,"a":[accessories]}
+ * accessory:       {"i":aid,"t":type,"s":[services]}
+ * service:         {"i":iid,"t":type,"c":[characteristics]}
+ * characteristic:  {"i":iid,"t":type,"p":perms,"v":value,"f":format,"u":unit,"x":maxValue,"m":minValue,"s":minStep}
+ * @param cont
+ * @return 
+ */
+char* marshalContainerCompact(Container* cont);
 
 #ifdef	__cplusplus
 }
@@ -32,7 +32,7 @@
 //#define DTXT(...)
 
 // service types
-const char* ServiceTypes[] = {
+const char ServiceTypes[][SERVICE_TYPE_SIZE] FLASH_STR_ATTR = {
     "3E",
     "8D",
     "96",
@@ -121,12 +121,6 @@ AccessoryInformation* ICACHE_FLASH_ATTR NewAccessoryInformation(void)
         goto defer;
     }
     
-    DTXT("NewAccessoryInformation(Identify): %s\n", svc->Identify->Bool->Type);
-    DTXT("NewAccessoryInformation(Manufacturer): %s\n", svc->Manufacturer->String->Type);
-    DTXT("NewAccessoryInformation(Model): %s\n", svc->Model->String->Type);
-    DTXT("NewAccessoryInformation(Name): %s\n", svc->Name->String->Type);
-    DTXT("NewAccessoryInformation(SerialNumber): %s\n", svc->SerialNumber->String->Type);
-            
     AddCharacteristic(svc->Service, svc->Identify->Bool);
     AddCharacteristic(svc->Service, svc->Manufacturer->String);
     AddCharacteristic(svc->Service, svc->Model->String);
@@ -490,6 +484,8 @@ Service* ICACHE_FLASH_ATTR NewService(const char* typ)
  */
 void ICACHE_FLASH_ATTR AddCharacteristic(Service* s, Characteristic* c)
 {
+    c->parent = s;
+    
     if(s->Characteristics != NULL) {
         Characteristic* ptr = s->Characteristics;
         
@@ -238,6 +238,10 @@ sint64_t GetID(Service* s);
 #define TypeWindow                          ServiceTypes[26]
 #define TypeWindowCovering                  ServiceTypes[27]
 
+#define SERVICE_TYPE_SIZE                   4
+
+extern const char ServiceTypes[][SERVICE_TYPE_SIZE];
+
 #ifdef	__cplusplus
 }
 #endif
@@ -32,6 +32,29 @@
 
 #define DTXT(...)   os_printf(__VA_ARGS__)
 
+typedef struct {
+    const char*     word;
+    const char*     token;
+} TopicToken;
+
+// reserved words and their tokens in the compact topic layout
+static const TopicToken topicTokens[] = {
+    { fabricFeeds,                  fabricCompactFeeds },
+    { fabricOfframp,                fabricCompactOfframp },
+    { fabricOnramp,                 fabricCompactOnramp },
+    { fabricCommands,               fabricCompactCommands },
+    { fabricClients,                fabricCompactClients },
+    { fabricSys,                    fabricCompactSys },
+    { fabricCmdStatus,              fabricCompactCmdStatus },
+    { fabricTaskIdService,          fabricCompactTaskIdService },
+    { fabricTaskIdDebug,            fabricCompactTaskIdDebug },
+    { fabricServiceIdFromHK,        fabricCompactFromHK },
+    { fabricServiceIdToHK,          fabricCompactToHK },
+    { fabricServiceIdAccessories,   fabricCompactAccessories },
+    { fabricServiceIdDebug,         fabricCompactDebug },
+    { fabricServiceIdState,         fabricCompactState }
+};
+
 /******************************************************************************************************************
  * public functions
  *
@@ -50,22 +73,34 @@ int ICACHE_FLASH_ATTR topicStatusPublish(   Mqtt* mqtt,
 
     if(topic == 0) {
         return  os_strlen(mqtt->rootTopic) + 1 +
-                os_strlen(mqtt->actorId) +
-                os_strlen("/$commands/$clients/") +
-                os_strlen(fabricSys) + 1 +
-                os_strlen(mqtt->actorPlatformId) + 1 +
-                os_strlen(fabricCmdStatus) + 1;
+                os_strlen(topicNodename(mqtt)) + 1 +
+                os_strlen(topicToken(mqtt, fabricCommands)) + 1 +
+                os_strlen(topicToken(mqtt, fabricClients)) + 1 +
+                os_strlen(topicToken(mqtt, fabricSys)) + 1 +
+                os_strlen(topicPlatformId(mqtt)) + 1 +
+                os_strlen(topicToken(mqtt, fabricCmdStatus)) + 1 +
+                (mqtt->statusClass ? os_strlen(mqtt->statusClass) + 1 : 0);
     }
     
     strcpy(topic, mqtt->rootTopic);
     strcat(topic, "/");
-    strcat(topic, mqtt->actorId);
-    strcat(topic, "/$commands/$clients/");
-    strcat(topic, fabricSys);
+    strcat(topic, topicNodename(mqtt));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricCommands));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricClients));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricSys));
     strcat(topic, "/");
-    strcat(topic, mqtt->actorPlatformId);
+    strcat(topic, topicPlatformId(mqtt));
     strcat(topic, "/");
-    strcat(topic, fabricCmdStatus);
+    strcat(topic, topicToken(mqtt, fabricCmdStatus));
+    
+    // status topics carry the class; see MqttOptions::StatusByClass
+    if(mqtt->statusClass) {
+        strcat(topic, "/");
+        strcat(topic, mqtt->statusClass);
+    }
 
     return ret;
 }
@@ -82,22 +117,34 @@ int ICACHE_FLASH_ATTR topicStatusSubscribe( Mqtt* mqtt,
 
     if(topic == 0) {
         return  os_strlen(mqtt->rootTopic) + 1 +
-                os_strlen(fabricTopicAny) +
-                os_strlen("/$commands/$clients/") +
-                os_strlen(fabricSys) + 1 +
                 os_strlen(fabricTopicAny) + 1 +
-                os_strlen(fabricCmdStatus) + 1;
+                os_strlen(topicToken(mqtt, fabricCommands)) + 1 +
+                os_strlen(topicToken(mqtt, fabricClients)) + 1 +
+                os_strlen(topicToken(mqtt, fabricSys)) + 1 +
+                os_strlen(fabricTopicAny) + 1 +
+                os_strlen(topicToken(mqtt, fabricCmdStatus)) + 1 +
+                (mqtt->statusFilter ? os_strlen(mqtt->statusFilter) + 1 : 0);
     }
 
     strcpy(topic, mqtt->rootTopic);
     strcat(topic, "/");
     strcat(topic, fabricTopicAny);
-    strcat(topic, "/$commands/$clients/");
-    strcat(topic, fabricSys);
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricCommands));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricClients));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricSys));
     strcat(topic, "/");
     strcat(topic, fabricTopicAny);
     strcat(topic, "/");
-    strcat(topic, fabricCmdStatus);
+    strcat(topic, topicToken(mqtt, fabricCmdStatus));
+    
+    // let the broker filter on the class of the sender
+    if(mqtt->statusFilter) {
+        strcat(topic, "/");
+        strcat(topic, mqtt->statusFilter);
+    }
 
     return ret;
 }
@@ -120,22 +167,27 @@ int ICACHE_FLASH_ATTR topicCommandPublish(  Mqtt* mqtt,
 
     if(topic == 0) {
         return  os_strlen(mqtt->rootTopic) + 1 +
-                os_strlen(mqtt->actorId) +
-                os_strlen("/$commands/$clients/") +
-                os_strlen(actorId) + 1 +
+                os_strlen(topicNodename(mqtt)) + 1 +
+                os_strlen(topicToken(mqtt, fabricCommands)) + 1 +
+                os_strlen(topicToken(mqtt, fabricClients)) + 1 +
+                os_strlen(topicToken(mqtt, actorId)) + 1 +
                 os_strlen(platformId) + 1 +
-                os_strlen(feedId) + 1;
+                os_strlen(topicToken(mqtt, feedId)) + 1;
     }
 
     strcpy(topic, mqtt->rootTopic);
     strcat(topic, "/");
-    strcat(topic, mqtt->actorId);
-    strcat(topic, "/$commands/$clients/");
-    strcat(topic, actorId);
+    strcat(topic, topicNodename(mqtt));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricCommands));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricClients));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, actorId));
     strcat(topic, "/");
     strcat(topic, platformId);
     strcat(topic, "/");
-    strcat(topic, feedId);
+    strcat(topic, topicToken(mqtt, feedId));
 
     return ret;
 }
@@ -160,22 +212,27 @@ int ICACHE_FLASH_ATTR topicCommandSubscribe(Mqtt* mqtt,
 
     if(topic == 0) {
         return  os_strlen(mqtt->rootTopic) + 1 +
-                os_strlen(nodename) +
-                os_strlen("/$commands/$clients/") +
-                os_strlen(actorId) + 1 +
+                os_strlen(nodename) + 1 +
+                os_strlen(topicToken(mqtt, fabricCommands)) + 1 +
+                os_strlen(topicToken(mqtt, fabricClients)) + 1 +
+                os_strlen(topicToken(mqtt, actorId)) + 1 +
                 os_strlen(platformId) + 1 +
-                os_strlen(feedId) + 1;
+                os_strlen(topicToken(mqtt, feedId)) + 1;
     }
 
     strcpy(topic, mqtt->rootTopic);
     strcat(topic, "/");
     strcat(topic, nodename);
-    strcat(topic, "/$commands/$clients/");
-    strcat(topic, actorId);
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricCommands));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricClients));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, actorId));
     strcat(topic, "/");
     strcat(topic, platformId);
     strcat(topic, "/");
-    strcat(topic, feedId);
+    strcat(topic, topicToken(mqtt, feedId));
 
     return ret;
 }
@@ -206,31 +263,36 @@ int ICACHE_FLASH_ATTR topicOfframpSubscribe(Mqtt*       mqtt,
 
     if(topic == 0) {
         return  os_strlen(mqtt->rootTopic) + 1 +
-                os_strlen(nodename) +
-                os_strlen("/$feeds/$offramp/") +
+                os_strlen(nodename) + 1 +
+                os_strlen(topicToken(mqtt, fabricFeeds)) + 1 +
+                os_strlen(topicToken(mqtt, fabricOfframp)) + 1 +
                 os_strlen(actorId) + 1 +
                 os_strlen(actorPlatformId) + 1 +
-                os_strlen(taskId) + 1 +
+                os_strlen(topicToken(mqtt, taskId)) + 1 +
                 os_strlen(platformId) + 1 +
-                os_strlen(serviceId) + 1 +
-                os_strlen(feedId) + 1;
+                os_strlen(topicToken(mqtt, serviceId)) + 1 +
+                os_strlen(topicToken(mqtt, feedId)) + 1;
     }
 
     strcpy(topic, mqtt->rootTopic);
     strcat(topic, "/");
     strcat(topic, nodename);
-    strcat(topic, "/$feeds/$offramp/");
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricFeeds));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricOfframp));
+    strcat(topic, "/");
     strcat(topic, actorId);
     strcat(topic, "/");
     strcat(topic, actorPlatformId);
     strcat(topic, "/");
-    strcat(topic, taskId);
+    strcat(topic, topicToken(mqtt, taskId));
     strcat(topic, "/");
     strcat(topic, platformId);
     strcat(topic, "/");
-    strcat(topic, serviceId);
+    strcat(topic, topicToken(mqtt, serviceId));
     strcat(topic, "/");
-    strcat(topic, feedId);
+    strcat(topic, topicToken(mqtt, feedId));
 
     return ret;
 }
@@ -257,31 +319,36 @@ int ICACHE_FLASH_ATTR topicOfframpPublish(  Mqtt*       mqtt,
 
     if(topic == 0) {
         return  os_strlen(mqtt->rootTopic) + 1 +
-                os_strlen(nodename) +
-                os_strlen("/$feeds/$offramp/") +
-                os_strlen(mqtt->actorId) + 1 +
-                os_strlen(mqtt->actorPlatformId) + 1 +
-                os_strlen(taskId) + 1 +
+                os_strlen(nodename) + 1 +
+                os_strlen(topicToken(mqtt, fabricFeeds)) + 1 +
+                os_strlen(topicToken(mqtt, fabricOfframp)) + 1 +
+                os_strlen(topicNodename(mqtt)) + 1 +
+                os_strlen(topicPlatformId(mqtt)) + 1 +
+                os_strlen(topicToken(mqtt, taskId)) + 1 +
                 os_strlen(platformId) + 1 +
-                os_strlen(serviceId) + 1 +
-                os_strlen(feedId) + 1;
+                os_strlen(topicToken(mqtt, serviceId)) + 1 +
+                os_strlen(topicToken(mqtt, feedId)) + 1;
     }
 
     strcpy(topic, mqtt->rootTopic);
     strcat(topic, "/");
     strcat(topic, nodename);
-    strcat(topic, "/$feeds/$offramp/");
-    strcat(topic, mqtt->actorId);
     strcat(topic, "/");
-    strcat(topic, mqtt->actorPlatformId);
+    strcat(topic, topicToken(mqtt, fabricFeeds));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, fabricOfframp));
+    strcat(topic, "/");
+    strcat(topic, topicNodename(mqtt));
+    strcat(topic, "/");
+    strcat(topic, topicPlatformId(mqtt));
     strcat(topic, "/");
-    strcat(topic, taskId);
+    strcat(topic, topicToken(mqtt, taskId));
     strcat(topic, "/");
     strcat(topic, platformId);
     strcat(topic, "/");
-    strcat(topic, serviceId);
+    strcat(topic, topicToken(mqtt, serviceId));
     strcat(topic, "/");
-    strcat(topic, feedId);
+    strcat(topic, topicToken(mqtt, feedId));
 
     return ret;
 }
@@ -305,15 +372,74 @@ int ICACHE_FLASH_ATTR topicOnrampPublish(   Mqtt*       mqtt,
     strcpy(topic, mqtt->rootTopic);
     strcat(topic, "/");
     strcat(topic, nodename);
-    strcat(topic, "/$feeds/$onramp/");
-    strcat(topic, mqtt->actorPlatformId);
     strcat(topic, "/");
-    strcat(topic, serviceId);
+    strcat(topic, topicToken(mqtt, fabricFeeds));
     strcat(topic, "/");
-    strcat(topic, feedId);
+    strcat(topic, topicToken(mqtt, fabricOnramp));
+    strcat(topic, "/");
+    strcat(topic, topicPlatformId(mqtt));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, serviceId));
+    strcat(topic, "/");
+    strcat(topic, topicToken(mqtt, feedId));
 
     return ret;    
 }
+/**
+ * 
+ * @param mqtt
+ * @param word
+ * @return 
+ */
+const char* ICACHE_FLASH_ATTR topicToken(Mqtt* mqtt, const char* word)
+{
+    if(mqtt->compactTopics) {
+        for(size_t i = 0; i < sizeof(topicTokens) / sizeof(topicTokens[0]); i++) {
+            if(os_strcmp(word, topicTokens[i].word) == 0) {
+                return topicTokens[i].token;
+            }
+        }
+    }
+    
+    return word;
+}
+/**
+ * 
+ * @param mqtt
+ * @param token
+ * @return 
+ */
+const char* ICACHE_FLASH_ATTR topicTokenExpand(Mqtt* mqtt, const char* token)
+{
+    // all tokens are reserved words
+    if(mqtt->compactTopics && token[0] == '$') {
+        for(size_t i = 0; i < sizeof(topicTokens) / sizeof(topicTokens[0]); i++) {
+            if(os_strcmp(token, topicTokens[i].token) == 0) {
+                return topicTokens[i].word;
+            }
+        }
+    }
+    
+    return token;
+}
+/**
+ * 
+ * @param mqtt
+ * @return 
+ */
+const char* ICACHE_FLASH_ATTR topicNodename(Mqtt* mqtt)
+{
+    return (mqtt->nodenameAlias != 0) ? mqtt->nodenameAlias : mqtt->actorId;
+}
+/**
+ * 
+ * @param mqtt
+ * @return 
+ */
+const char* ICACHE_FLASH_ATTR topicPlatformId(Mqtt* mqtt)
+{
+    return (mqtt->platformIdAlias != 0) ? mqtt->platformIdAlias : mqtt->actorPlatformId;
+}
 /**
  * 
  * @param t
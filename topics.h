@@ -40,10 +40,17 @@ typedef struct Mqtt Mqtt;
 
 #define FabricNodenameAny           "+"
 
+#define fabricFeeds                 "$feeds"
+#define fabricOfframp               "$offramp"
+#define fabricOnramp                "$onramp"
+#define fabricCommands              "$commands"
+#define fabricClients               "$clients"
+
 #define fabricSys                   "sysctl"
 #define fabricCmdStatus             "status"
 
 #define fabricTopicAny              "+"
+#define fabricTopicAll              "#"
 #define fabricNodenameBroadcast     "broadcast"
 
 #define fabricServiceIdRpcServer    "rpc_server"
@@ -52,10 +59,31 @@ typedef struct Mqtt Mqtt;
 #define fabricServiceIdToHK         "to_hk"
 #define fabricServiceIdAccessories  "accessories"
 #define fabricServiceIdDebug        "debug"
+#define fabricServiceIdState        "state"
 
 #define fabricTaskIdService         "svc"
 #define fabricTaskIdDebug           "dbg"
 
+/******************************************************************************************************************
+ * compact topic layout (MqttOptions::CompactTopics); the reserved words above are sent as these tokens
+ *
+ */
+
+#define fabricCompactFeeds          "$f"
+#define fabricCompactOfframp        "$o"
+#define fabricCompactOnramp         "$n"
+#define fabricCompactCommands       "$c"
+#define fabricCompactClients        "$l"
+#define fabricCompactSys            "$y"
+#define fabricCompactCmdStatus      "$s"
+#define fabricCompactTaskIdService  "$v"
+#define fabricCompactTaskIdDebug    "$d"
+#define fabricCompactFromHK         "$h"
+#define fabricCompactToHK           "$k"
+#define fabricCompactAccessories    "$a"
+#define fabricCompactDebug          "$g"
+#define fabricCompactState          "$e"
+
 #define SUBTOPIC_SIZE               32
 
 typedef struct {
@@ -173,6 +201,32 @@ int topicOnrampPublish( Mqtt*       mqtt,
                         const char* serviceId,
                         const char* feedId,
                         char*       topic);
+/**
+ * topicToken returns the token to send for a reserved word - the word itself unless compact topics are used
+ * @param mqtt
+ * @param word
+ * @return 
+ */
+const char* topicToken(Mqtt* mqtt, const char* word);
+/**
+ * topicTokenExpand is the reverse of topicToken()
+ * @param mqtt
+ * @param token
+ * @return 
+ */
+const char* topicTokenExpand(Mqtt* mqtt, const char* token);
+/**
+ * topicNodename returns our nodename as used in topics, i.e. our alias with compact topics
+ * @param mqtt
+ * @return 
+ */
+const char* topicNodename(Mqtt* mqtt);
+/**
+ * 
+ * @param mqtt
+ * @return 
+ */
+const char* topicPlatformId(Mqtt* mqtt);
 /**
  * 
  * @param t